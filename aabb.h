@@ -14,21 +14,49 @@ public:
 	vec::vec3 _min, _max; // left lower cornor, top right
 };
 
+// branchless slab test: the ray's sign bits pick the near and far plane of each slab, so there is no swap and no early out
 inline bool aabb::hit(const ray &_ray, float t_min, float t_max) const
 {
 	for (int i = 0; i < 3; i++)
 	{
-		float invD = 1.0f / _ray.direction()[i];
-		float t0 = (min()[i] - _ray.origin()[i]) * invD;
-		float t1 = (max()[i] - _ray.origin()[i]) * invD;
-		if (invD < 0.0f)
-			std::swap(t0, t1);
+		float t0 = ((_ray.sign[i] ? _max : _min)[i] - _ray.ori[i]) * _ray.inv_dir[i];
+		float t1 = ((_ray.sign[i] ? _min : _max)[i] - _ray.ori[i]) * _ray.inv_dir[i];
 		t_min = t0 > t_min ? t0 : t_min;
 		t_max = t1 < t_max ? t1 : t_max; // wrong write: t_max = t0 > t_max ? t0 : t_max; lead to lower than before
-		if (t_max <= t_min)
-			return false;
 	}
-	return true;
+	return t_min < t_max;
+}
+
+// one ray against N boxes stored as separate coordinate arrays (bmin[axis][box]). returns a bit per box that is hit
+// and writes each box's entry distance. plain loops over N with no branches, so the compiler can vectorize them
+template <int N>
+inline int hit_boxes(const ray &_ray, const float (&bmin)[3][N], const float (&bmax)[3][N], float t_min, float t_max, float (&t_entry)[N])
+{
+	float near[N], far[N];
+	for (int b = 0; b < N; ++b)
+	{
+		near[b] = t_min;
+		far[b] = t_max;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		const float *lo = _ray.sign[i] ? bmax[i] : bmin[i];
+		const float *hi = _ray.sign[i] ? bmin[i] : bmax[i];
+		for (int b = 0; b < N; ++b)
+		{
+			float t0 = (lo[b] - _ray.ori[i]) * _ray.inv_dir[i];
+			float t1 = (hi[b] - _ray.ori[i]) * _ray.inv_dir[i];
+			near[b] = t0 > near[b] ? t0 : near[b];
+			far[b] = t1 < far[b] ? t1 : far[b];
+		}
+	}
+	int mask = 0;
+	for (int b = 0; b < N; ++b)
+	{
+		t_entry[b] = near[b];
+		mask |= (near[b] < far[b]) << b;
+	}
+	return mask;
 }
 
 inline aabb surrounding_box(aabb box0, aabb box1)
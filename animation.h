@@ -0,0 +1,38 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include "linear_bvh.h"
+#include "transform.h"
+
+// motion from one frame to the next, where moving_sphere only moves within one shutter interval. every track is a
+// transform whose matrix is a function of the sequence time, and the bvh over the tracks is refit rather than rebuilt
+class animation
+{
+public:
+    typedef std::function<vec::mat3x4(float)> motion;
+
+    void add(std::shared_ptr<transform> node, motion path) { tracks.push_back(track{node, path}); }
+
+    // moves every track to sequence time t in [0, 1], update_bvh follows
+    void set_time(float t)
+    {
+        for (track &k : tracks)
+            k.node->set_to_world(k.path(t));
+    }
+
+    bvh_update_stats update_bvh(float time0, float time1) { return bvh ? bvh->update(time0, time1, max_growth) : bvh_update_stats(); }
+
+    bool empty() const { return tracks.empty(); }
+
+    std::shared_ptr<linear_bvh> bvh; // over the tracks, NULL when they are not under one
+    float max_growth = 2.0f;
+
+private:
+    struct track
+    {
+        std::shared_ptr<transform> node;
+        motion path;
+    };
+    std::vector<track> tracks;
+};
@@ -10,41 +10,37 @@ public:
 	bvh_node_sp(std::shared_ptr<hitable> *l, int n, float time0, float time1);
 	
 	virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
+	virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
 	virtual bool bounding_box(float t0, float t1, aabb &bbox) const override;
 
 	std::shared_ptr<hitable> left, right;
 	aabb bbox;
+	int axis = 0; // split axis, quick_sort orders by x
 };
 
 bool bvh_node_sp::hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const
 {
 	if (bbox.hit(_ray, t_min, t_max))
 	{
-		hit_record left_rec, right_rec;
-		bool hit_left = left->hit(_ray, t_min, t_max, left_rec);
-		bool hit_right = right->hit(_ray, t_min, t_max, right_rec);
-		if (hit_left && hit_right)  // two aabb have intersection
-		{
-			if (left_rec.t < right_rec.t)  // choose the closer one
-				rec = left_rec;
-			else
-				rec = right_rec;
-			return true;
-		}
-		else if (hit_left)
-		{
-			rec = left_rec;
-			return true;
-		}
-		else if (hit_right)
-		{
-			rec = right_rec;
-			return true;
-		}
+		// visit the child on the near side of the split first, a hit there shortens the interval the far child is tested with
+		const hitable *first = left.get(), *second = right.get();
+		if (_ray.sign[axis])
+			std::swap(first, second);
+		bool hit_first = first->hit(_ray, t_min, t_max, rec);
+		if (first == second)
+			return hit_first;
+		bool hit_second = second->hit(_ray, t_min, hit_first ? rec.t : t_max, rec); // rec is only written on a closer hit
+		return hit_first || hit_second;
 	}
 	return false;
 }
 
+bool bvh_node_sp::hit_any(const ray &_ray, float t_min, float t_max) const
+{
+	// no ordering needed, any child that is hit ends the query
+	return bbox.hit(_ray, t_min, t_max) && (left->hit_any(_ray, t_min, t_max) || (right != left && right->hit_any(_ray, t_min, t_max)));
+}
+
 bool bvh_node_sp::bounding_box(float t0, float t1, aabb &box) const
 {
 	box = bbox;
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "framebuffer.h"
+#include "render.h"
+
+// progressive render state on disk, little enough to rewrite every few minutes:
+//   char magic[8] "RTCKPT3\n"
+//   int32 nx, ny, pass_samples, passes_done, sample_count, uint32 seed, name_length, sampler_length, name bytes, sampler bytes
+//   float sums[nx * ny * 3], int32 counts[nx * ny]
+// the random state needs no storing: pass k reseeds every pixel from (seed, x, y, k), so continuing at passes_done
+// draws exactly what the interrupted run would have drawn
+static const char checkpoint_magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '3', '\n'};
+
+struct checkpoint_header
+{
+    int32_t nx, ny, pass_samples, passes_done;
+    int32_t sample_count; // -s, the stratified sampler lays its strata out for it
+    uint32_t seed, name_length, sampler_length; // each sampler is its own estimator, their sums do not mix
+};
+
+// written to path.tmp, flushed to disk, then renamed over path, so a preempted node leaves either the old or the new checkpoint
+bool save_checkpoint(const std::string &path, const render_settings &settings, const std::string &scene_name, int passes_done, const framebuffer &fb)
+{
+    std::string tmp_path = path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp)
+    {
+        std::cerr << "can not open " << tmp_path << std::endl;
+        return false;
+    }
+    checkpoint_header header = {settings.nx, settings.ny, std::max(1, settings.pass_samples), passes_done, std::max(1, settings.ns), settings.seed,
+                                (uint32_t)scene_name.size(), (uint32_t)settings.sampler.size()};
+    bool ok = fwrite(checkpoint_magic, 1, sizeof(checkpoint_magic), fp) == sizeof(checkpoint_magic) &&
+              fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(scene_name.data(), 1, scene_name.size(), fp) == scene_name.size() &&
+              fwrite(settings.sampler.data(), 1, settings.sampler.size(), fp) == settings.sampler.size() &&
+              fwrite(fb.sums.data(), sizeof(vec::vec3), fb.sums.size(), fp) == fb.sums.size() &&
+              fwrite(fb.counts.data(), sizeof(int), fb.counts.size(), fp) == fb.counts.size();
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "write checkpoint " << path << " error" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// fills fb (sums, counts and the averaged pixels) and returns the passes already done, -1 if the file is missing,
+// damaged, or was written for another image size, pass size, seed, sampler or scene. a stratified render also needs the
+// same -s: another sample count is another strata layout, and the sums of two layouts do not mix
+int load_checkpoint(const std::string &path, const render_settings &settings, const std::string &scene_name, framebuffer &fb)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        std::cerr << "can not open " << path << std::endl;
+        return -1;
+    }
+    char magic[sizeof(checkpoint_magic)];
+    checkpoint_header header;
+    std::string name, sampler_name;
+    bool ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && !memcmp(magic, checkpoint_magic, sizeof(magic)) &&
+              fread(&header, sizeof(header), 1, fp) == 1 && header.name_length < 4096 && header.sampler_length < 4096;
+    if (ok)
+    {
+        name.resize(header.name_length);
+        sampler_name.resize(header.sampler_length);
+        ok = fread(&name[0], 1, name.size(), fp) == name.size() && fread(&sampler_name[0], 1, sampler_name.size(), fp) == sampler_name.size();
+    }
+    if (!ok)
+    {
+        std::cerr << path << " is not a checkpoint" << std::endl;
+        fclose(fp);
+        return -1;
+    }
+    if (header.nx != settings.nx || header.ny != settings.ny || header.pass_samples != std::max(1, settings.pass_samples) ||
+        header.seed != settings.seed || name != scene_name || sampler_name != settings.sampler ||
+        (sampler_name == "stratified" && header.sample_count != std::max(1, settings.ns)))
+    {
+        std::cerr << path << " was written for " << name << " " << header.nx << "x" << header.ny << " pass " << header.pass_samples
+                  << " seed " << header.seed << " sampler " << sampler_name << " samples " << header.sample_count << ", which does not match this render"
+                  << std::endl;
+        fclose(fp);
+        return -1;
+    }
+    fb.sums.resize(fb.pixels.size());
+    ok = fread(fb.sums.data(), sizeof(vec::vec3), fb.sums.size(), fp) == fb.sums.size() &&
+         fread(fb.counts.data(), sizeof(int), fb.counts.size(), fp) == fb.counts.size();
+    fclose(fp);
+    if (!ok)
+    {
+        std::cerr << path << " is truncated" << std::endl;
+        return -1;
+    }
+    for (size_t i = 0; i < fb.pixels.size(); ++i)
+        fb.pixels[i] = fb.counts[i] ? fb.sums[i] / (float)fb.counts[i] : vec::vec3(0);
+    return header.passes_done;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "vec3.h"
+
+struct tile
+{
+    int x0, y0, x1, y1; // [x0, x1) x [y0, y1)
+};
+
+// linear radiance per pixel, row 0 is the bottom of the image (same as camera v)
+class framebuffer
+{
+public:
+    framebuffer() : nx(0), ny(0){};
+    framebuffer(int nx, int ny) : nx(nx), ny(ny), pixels(nx * ny), counts(nx * ny){};
+
+    inline vec::vec3 &at(int x, int y) { return pixels[y * nx + x]; }
+    inline const vec::vec3 &at(int x, int y) const { return pixels[y * nx + x]; }
+    inline int &count_at(int x, int y) { return counts[y * nx + x]; }
+    inline int count_at(int x, int y) const { return counts[y * nx + x]; }
+    inline vec::vec3 &sum_at(int x, int y) { return sums[y * nx + x]; }
+
+    uint64_t total_samples() const
+    {
+        uint64_t total = 0;
+        for (int n : counts)
+            total += n;
+        return total;
+    }
+
+    int nx, ny;
+    std::vector<vec::vec3> pixels;
+    std::vector<int> counts; // samples taken per pixel, differs between pixels in adaptive mode
+    std::vector<vec::vec3> sums; // running radiance sums, only allocated by progressive rendering
+};
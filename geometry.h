@@ -1,4 +1,7 @@
 #pragma once
+#include <algorithm>
+#include <map>
+#include <vector>
 #include "hitablelist.h"
 #include "onb.h"
 #include "rand.h"
@@ -18,16 +21,19 @@ public:
     sphere(vec::vec3 center, float radius, std::shared_ptr<material> mat_ptr) : center(center), radius(radius), mat_ptr(mat_ptr){};
 
     virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
+    virtual int hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const override;
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const;
     float pdf_value(const vec::vec3 &o, const vec::vec3 &v) const;
     vec::vec3 random(const vec::vec3 &o) const;
-    void get_sphere_uv(float &u, float &v, const vec::vec3 &point) const;
+    static void get_sphere_uv(float &u, float &v, const vec::vec3 &point);
+    inline void set_record(const ray &ray, float t, hit_record &rec) const;
 
     vec::vec3 center;
     float radius;
     std::shared_ptr<material> mat_ptr;
 };
-inline void sphere::get_sphere_uv(float &u, float &v, const vec::vec3 &point) const
+inline void sphere::get_sphere_uv(float &u, float &v, const vec::vec3 &point)
 {
     float phi = atan2(point.x(), point.z()); // atan2 [-π，π]
     float theta = acos(-point.y());
@@ -36,8 +42,7 @@ inline void sphere::get_sphere_uv(float &u, float &v, const vec::vec3 &point) co
 }
 float sphere::pdf_value(const vec::vec3 &o, const vec::vec3 &v) const
 {
-    hit_record rec;
-    if (this->hit(ray(o, v), 0.001, FLT_MAX, rec))
+    if (this->hit_any(ray(o, v), 0.001, FLT_MAX))
     {
         float cos_theta_max = sqrt(1 - radius * radius / (center - o).squared_length());
         float solid_angle = 2 * M_PI * (1 - cos_theta_max);
@@ -55,6 +60,14 @@ vec::vec3 sphere::random(const vec::vec3 &o) const
     return uvw.local(random_to_sphere(radius, distance_squared));
     // return uvw.local(random_cosine_direction());
 }
+inline void sphere::set_record(const ray &ray, float t, hit_record &rec) const
+{
+    rec.t = t;
+    rec.point = ray.point_at_parameter(rec.t);
+    rec.normal = (rec.point - center) / radius;
+    rec.mat_ptr = mat_ptr.get();
+    get_sphere_uv(rec.u, rec.v, rec.normal);
+}
 bool sphere::hit(const ray &ray, float t_min, float t_max, hit_record &rec) const
 {
     float a = vec::dot(ray.dir, ray.dir);
@@ -66,29 +79,65 @@ bool sphere::hit(const ray &ray, float t_min, float t_max, hit_record &rec) cons
         float temp = (-b - sqrt(delta)) / a;
         if (temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.point = ray.point_at_parameter(rec.t);
-            rec.normal = (rec.point - center) / radius;
-            rec.mat_ptr = mat_ptr;
-            get_sphere_uv(rec.u, rec.v, rec.normal);
+            set_record(ray, temp, rec);
             return true;
         }
         temp = (-b + sqrt(delta)) / a;
         if (temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.point = ray.point_at_parameter(rec.t);
-            rec.normal = (rec.point - center) / radius;
-            rec.mat_ptr = mat_ptr;
-            get_sphere_uv(rec.u, rec.v, rec.normal);
+            set_record(ray, temp, rec);
             return true;
         }
     }
     return false;
 }
+// same arithmetic as hit on 8 lanes at once, records are only filled for the lanes that hit
+int sphere::hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const
+{
+    vec::vec3x8 oc = packet.ori - vec::vec3x8(center);
+    vec::float8 a = vec::dot(packet.dir, packet.dir);
+    vec::float8 b = vec::dot(packet.dir, oc);
+    vec::float8 c = vec::dot(oc, oc) - vec::float8(radius * radius);
+    vec::float8 delta = b * b - a * c;
+    mask &= vec::bits(delta > vec::float8(0.0f));
+    if (!mask)
+        return 0;
+    vec::float8 root = vec::sqrt(delta), lo(t_min), hi = vec::float8::load(t_max);
+    vec::float8 t_near = (-b - root) / a, t_far = (-b + root) / a;
+    vec::float8 near_ok = (t_near < hi) & (t_near > lo);
+    vec::float8 far_ok = (t_far < hi) & (t_far > lo);
+    int hits = mask & vec::bits(near_ok | far_ok);
+    alignas(32) float t[ray_packet::size];
+    vec::select(near_ok, t_near, t_far).store(t);
+    for (int lane = 0; lane < ray_packet::size; ++lane)
+    {
+        if (hits >> lane & 1)
+        {
+            set_record(packet.rays[lane], t[lane], rec[lane]);
+            t_max[lane] = t[lane];
+        }
+    }
+    return hits;
+}
+bool sphere::hit_any(const ray &ray, float t_min, float t_max) const
+{
+    vec::vec3 oc = ray.ori - center;
+    float a = vec::dot(ray.dir, ray.dir);
+    float b = vec::dot(ray.dir, oc);
+    float c = vec::dot(oc, oc) - radius * radius;
+    float delta = b * b - a * c;
+    if (delta <= 0)
+        return false;
+    float root = sqrt(delta);
+    float temp = (-b - root) / a;
+    if (temp < t_max && temp > t_min)
+        return true;
+    temp = (-b + root) / a;
+    return temp < t_max && temp > t_min;
+}
 bool sphere::bounding_box(float t0, float t1, aabb &bbox) const
 {
-    bbox = aabb(center - vec::vec3(radius), center + vec::vec3(radius));
+    bbox = aabb(center - vec::vec3(fabs(radius)), center + vec::vec3(fabs(radius))); // negative radius (hollow glass, skylight) would give an inverted box
     return true;
 }
 #pragma endregion
@@ -101,6 +150,7 @@ public:
     moving_sphere(vec::vec3 center0, vec::vec3 center1, float time0, float time1, float radius, std::shared_ptr<material> mat_ptr) : center0(center0), center1(center1), time0(time0), time1(time1), radius(radius), mat_ptr(mat_ptr){};
 
     virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const;
     vec::vec3 center(float time) const;
 
@@ -124,7 +174,7 @@ bool moving_sphere::hit(const ray &ray, float t_min, float t_max, hit_record &re
             rec.t = temp;
             rec.point = ray.point_at_parameter(temp);
             rec.normal = (rec.point - moving_center) / radius;
-            rec.mat_ptr = mat_ptr;
+            rec.mat_ptr = mat_ptr.get();
             return true;
         }
         return false;
@@ -140,10 +190,26 @@ bool moving_sphere::hit(const ray &ray, float t_min, float t_max, hit_record &re
     }
     return false;
 }
+bool moving_sphere::hit_any(const ray &ray, float t_min, float t_max) const
+{
+    vec::vec3 oc = ray.ori - center(ray.get_time());
+    float a = vec::dot(ray.dir, ray.dir);
+    float b = vec::dot(oc, ray.dir);
+    float c = vec::dot(oc, oc) - radius * radius;
+    float discriminant = b * b - a * c;
+    if (discriminant <= 0)
+        return false;
+    float root = sqrt(discriminant);
+    float temp = (-b - root) / a;
+    if (temp < t_max && temp > t_min)
+        return true;
+    temp = (-b + root) / a;
+    return temp < t_max && temp > t_min;
+}
 bool moving_sphere::bounding_box(float t0, float t1, aabb &bbox) const
 {
-    aabb bbox0 = aabb(center0 - vec::vec3(radius), center0 + vec::vec3(radius));
-    aabb bbox1 = aabb(center1 - vec::vec3(radius), center1 + vec::vec3(radius)); // wrong write center0, sphere is torn
+    aabb bbox0 = aabb(center0 - vec::vec3(fabs(radius)), center0 + vec::vec3(fabs(radius)));
+    aabb bbox1 = aabb(center1 - vec::vec3(fabs(radius)), center1 + vec::vec3(fabs(radius))); // wrong write center0, sphere is torn
     bbox = surrounding_box(bbox0, bbox1);
     return true;
 }
@@ -153,7 +219,193 @@ vec::vec3 moving_sphere::center(float time) const
 }
 #pragma endregion
 
+#pragma region sphere_set
+// up to 8 static spheres in one bvh leaf, kept as structure of arrays so a ray meets all of them in one run of float8
+// arithmetic instead of one virtual hit per sphere. a hit is the same t, point, normal and uv sphere::hit would give.
+// materials are indices into a palette shared by every set make_sphere_sets built together
+class sphere_set : public hitable
+{
+public:
+    static const int size = 8;
+    typedef std::vector<std::shared_ptr<material>> palette_type;
+
+    sphere_set() : count(0){};
+    sphere_set(const sphere *const *spheres, const int *materials, int n, std::shared_ptr<palette_type> palette);
+
+    virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
+    virtual bool bounding_box(float t0, float t1, aabb &bbox) const override;
+
+    alignas(32) float cx[size], cy[size], cz[size], radius[size];
+    int material_index[size];
+    int count;
+    aabb box;
+    std::shared_ptr<palette_type> palette;
+
+private:
+    inline int intersect(const ray &ray, float t_min, float t_max, vec::float8 &t) const;
+};
+
+sphere_set::sphere_set(const sphere *const *spheres, const int *materials, int n, std::shared_ptr<palette_type> palette) : count(std::min(n, (int)size)), palette(palette)
+{
+    for (int k = 0; k < size; ++k) // unused lanes are zero spheres at the origin, masked off by count
+    {
+        const sphere *s = k < count ? spheres[k] : NULL;
+        cx[k] = s ? s->center.x() : 0.0f;
+        cy[k] = s ? s->center.y() : 0.0f;
+        cz[k] = s ? s->center.z() : 0.0f;
+        radius[k] = s ? s->radius : 0.0f;
+        material_index[k] = s ? materials[k] : 0;
+        if (s)
+        {
+            aabb sphere_box;
+            s->bounding_box(0, 0, sphere_box);
+            box = k ? surrounding_box(box, sphere_box) : sphere_box;
+        }
+    }
+}
+
+// sphere::hit's arithmetic on every lane: lanes with a root in (t_min, t_max), and in t the nearer such root
+inline int sphere_set::intersect(const ray &ray, float t_min, float t_max, vec::float8 &t) const
+{
+    vec::float8 ocx = vec::float8(ray.ori.x()) - vec::float8::load(cx);
+    vec::float8 ocy = vec::float8(ray.ori.y()) - vec::float8::load(cy);
+    vec::float8 ocz = vec::float8(ray.ori.z()) - vec::float8::load(cz);
+    vec::float8 dx(ray.dir.x()), dy(ray.dir.y()), dz(ray.dir.z()), r = vec::float8::load(radius);
+    vec::float8 a(vec::dot(ray.dir, ray.dir));
+    vec::float8 b = dx * ocx + dy * ocy + dz * ocz;
+    vec::float8 c = (ocx * ocx + ocy * ocy + ocz * ocz) - r * r;
+    vec::float8 delta = b * b - a * c;
+    int mask = ((1 << count) - 1) & vec::bits(delta > vec::float8(0.0f));
+    if (!mask)
+        return 0;
+    vec::float8 root = vec::sqrt(delta), lo(t_min), hi(t_max);
+    vec::float8 t_near = (-b - root) / a, t_far = (-b + root) / a;
+    vec::float8 near_ok = (t_near < hi) & (t_near > lo);
+    vec::float8 far_ok = (t_far < hi) & (t_far > lo);
+    t = vec::select(near_ok, t_near, t_far);
+    return mask & vec::bits(near_ok | far_ok);
+}
+
+bool sphere_set::hit(const ray &ray, float t_min, float t_max, hit_record &rec) const
+{
+    vec::float8 t8;
+    int mask = intersect(ray, t_min, t_max, t8);
+    if (!mask)
+        return false;
+    alignas(32) float t[size];
+    t8.store(t);
+    int k = -1;
+    for (int lane = 0; lane < size; ++lane)
+        if (mask >> lane & 1 && (k < 0 || t[lane] < t[k]))
+            k = lane;
+    rec.t = t[k];
+    rec.point = ray.point_at_parameter(rec.t);
+    rec.normal = (rec.point - vec::vec3(cx[k], cy[k], cz[k])) / radius[k];
+    rec.mat_ptr = (*palette)[material_index[k]].get();
+    sphere::get_sphere_uv(rec.u, rec.v, rec.normal);
+    return true;
+}
+
+bool sphere_set::hit_any(const ray &ray, float t_min, float t_max) const
+{
+    vec::float8 t;
+    return intersect(ray, t_min, t_max, t) != 0;
+}
+
+bool sphere_set::bounding_box(float t0, float t1, aabb &bbox) const
+{
+    bbox = box;
+    return count > 0;
+}
+
+// sets of nearby spheres: the centers are split at the median of their widest axis until a group fits in one set,
+// so each set is compact and the bvh above the sets stays tight. order holds indices into spheres and is reordered
+inline void cluster_spheres(const std::vector<sphere> &spheres, const std::vector<int> &materials, int *order, int n,
+                            std::shared_ptr<sphere_set::palette_type> palette, std::vector<std::shared_ptr<hitable>> &sets)
+{
+    if (n <= sphere_set::size)
+    {
+        const sphere *group[sphere_set::size];
+        int group_materials[sphere_set::size];
+        for (int k = 0; k < n; ++k)
+        {
+            group[k] = &spheres[order[k]];
+            group_materials[k] = materials[order[k]];
+        }
+        sets.push_back(std::shared_ptr<hitable>(new sphere_set(group, group_materials, n, palette)));
+        return;
+    }
+    vec::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (int k = 0; k < n; ++k)
+        for (int i = 0; i < 3; ++i)
+        {
+            lo[i] = std::min(lo[i], spheres[order[k]].center[i]);
+            hi[i] = std::max(hi[i], spheres[order[k]].center[i]);
+        }
+    vec::vec3 extent = hi - lo;
+    int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    // cut at a multiple of the set size so only the last set of the group can be partly empty
+    int half = (n / 2 + sphere_set::size - 1) / sphere_set::size * sphere_set::size;
+    std::nth_element(order, order + half, order + n, [&](int l, int r)
+                     { return spheres[l].center[axis] < spheres[r].center[axis]; });
+    cluster_spheres(spheres, materials, order, half, palette, sets);
+    cluster_spheres(spheres, materials, order + half, n - half, palette, sets);
+}
+
+// static spheres to sphere_sets, to be put under a bvh in place of the spheres themselves
+std::vector<std::shared_ptr<hitable>> make_sphere_sets(const std::vector<sphere> &spheres)
+{
+    std::shared_ptr<sphere_set::palette_type> palette(new sphere_set::palette_type);
+    std::map<const material *, int> palette_index;
+    std::vector<int> materials(spheres.size()), order(spheres.size());
+    for (size_t i = 0; i < spheres.size(); ++i)
+    {
+        auto found = palette_index.find(spheres[i].mat_ptr.get());
+        if (found == palette_index.end())
+        {
+            found = palette_index.insert(std::make_pair(spheres[i].mat_ptr.get(), (int)palette->size())).first;
+            palette->push_back(spheres[i].mat_ptr);
+        }
+        materials[i] = found->second;
+        order[i] = (int)i;
+    }
+    std::vector<std::shared_ptr<hitable>> sets;
+    if (!spheres.empty())
+        cluster_spheres(spheres, materials, order.data(), (int)spheres.size(), palette, sets);
+    return sets;
+}
+#pragma endregion
+
 #pragma region rectangle
+// the rectangles' plane test on a packet: lanes in mask whose hit on the plane axis C = k lies inside
+// (a0, a1) x (b0, b1) on axes A and B. the caller fills records with its scalar hit for just those lanes
+template <int A, int B, int C>
+inline int rect_hit_packet(const ray_packet &packet, int mask, float t_min, const float *t_max, float a0, float a1, float b0, float b1, float k)
+{
+    const vec::float8 &oa = packet.axis(packet.ori, A), &ob = packet.axis(packet.ori, B), &oc = packet.axis(packet.ori, C);
+    const vec::float8 &da = packet.axis(packet.dir, A), &db = packet.axis(packet.dir, B), &dc = packet.axis(packet.dir, C);
+    vec::float8 t = (vec::float8(k) - oc) / dc;
+    vec::float8 a = oa + t * da, b = ob + t * db;
+    vec::float8 inside = (t < vec::float8::load(t_max)) & (t > vec::float8(t_min)) & (a > vec::float8(a0)) & (a < vec::float8(a1)) &
+                         (b > vec::float8(b0)) & (b < vec::float8(b1));
+    return mask & vec::bits(inside);
+}
+
+// hit_packet of a rectangle: simd plane test, then the scalar hit fills the record of every lane that passed
+#define RECT_HIT_PACKET(A, B, C, a0, a1, b0, b1)                                                                   \
+    virtual int hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const override \
+    {                                                                                                              \
+        int candidates = rect_hit_packet<A, B, C>(packet, mask, t_min, t_max, a0, a1, b0, b1, k), hits = 0;        \
+        for (int lane = 0; lane < ray_packet::size; ++lane)                                                        \
+            if (candidates >> lane & 1 && hit(packet.rays[lane], t_min, t_max[lane], rec[lane]))                    \
+            {                                                                                                      \
+                t_max[lane] = rec[lane].t;                                                                         \
+                hits |= 1 << lane;                                                                                 \
+            }                                                                                                      \
+        return hits;                                                                                               \
+    }
+
 class xy_rect : public hitable
 {
 public:
@@ -170,7 +422,7 @@ public:
             if (x > x0 && x < x1 && y > y0 && y < y1)
             {
                 rec.point = ray.point_at_parameter(t);
-                rec.mat_ptr = mat_ptr;
+                rec.mat_ptr = mat_ptr.get();
                 rec.normal = vec::vec3(0, 0, 1);
                 rec.u = (x - x0) / (x1 - x0);
                 rec.v = (y - y0) / (y1 - y0);
@@ -181,6 +433,25 @@ public:
         return false;
     }
 
+    // plane distance only, shared by hit_any and pdf_value
+    inline bool hit_t(const ray &ray, float t_min, float t_max, float &t) const
+    {
+        t = (k - ray.origin().z()) / ray.direction().z();
+        if (!(t < t_max && t > t_min))
+            return false;
+        float x = ray.origin().x() + t * ray.direction().x();
+        float y = ray.origin().y() + t * ray.direction().y();
+        return x > x0 && x < x1 && y > y0 && y < y1;
+    }
+
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override
+    {
+        float t;
+        return hit_t(ray, t_min, t_max, t);
+    }
+
+    RECT_HIT_PACKET(0, 1, 2, x0, x1, y0, y1)
+
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const override
     {
         bbox = aabb(vec::vec3(x0, y0, k - 0.0001), vec::vec3(x1, y1, k + 0.0001));
@@ -189,12 +460,12 @@ public:
 
     virtual float pdf_value(const vec::vec3 &o, const vec::vec3 &v) const override
     {
-        hit_record rec;
-        if (this->hit(ray(o, v), 0.001, FLT_MAX, rec))
+        float t;
+        if (hit_t(ray(o, v), 0.001, FLT_MAX, t))
         {
             float area = (x1 - x0) * (y1 - y0);
-            float distance_squared = rec.t * rec.t * v.squared_length();
-            float cosine = fabs(vec::dot(v, rec.normal) / v.length());
+            float distance_squared = t * t * v.squared_length();
+            float cosine = fabs(v.z() / v.length()); // normal is the z axis
             return distance_squared / (cosine * area);
         }
         return 0;
@@ -202,7 +473,9 @@ public:
 
     virtual vec::vec3 random(const vec::vec3 &o) const override
     {
-        vec::vec3 random_point = vec::vec3(x0 + rand_float() * (x1 - x0), y0 + rand_float() * (y1 - y0), k);
+        float r1, r2;
+        rand_2d(r1, r2);
+        vec::vec3 random_point = vec::vec3(x0 + r1 * (x1 - x0), y0 + r2 * (y1 - y0), k);
         return random_point - o;
     }
 
@@ -226,7 +499,7 @@ public:
             if (x > x0 && x < x1 && z > z0 && z < z1)
             {
                 rec.point = ray.point_at_parameter(t);
-                rec.mat_ptr = mat_ptr;
+                rec.mat_ptr = mat_ptr.get();
                 rec.normal = vec::vec3(0, 1, 0);
                 rec.u = (x - x0) / (x1 - x0);
                 rec.v = (z - z0) / (z1 - z0);
@@ -237,6 +510,25 @@ public:
         return false;
     }
 
+    // plane distance only, shared by hit_any and pdf_value
+    inline bool hit_t(const ray &ray, float t_min, float t_max, float &t) const
+    {
+        t = (k - ray.origin().y()) / ray.direction().y();
+        if (!(t < t_max && t > t_min))
+            return false;
+        float x = ray.origin().x() + t * ray.direction().x();
+        float z = ray.origin().z() + t * ray.direction().z();
+        return x > x0 && x < x1 && z > z0 && z < z1;
+    }
+
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override
+    {
+        float t;
+        return hit_t(ray, t_min, t_max, t);
+    }
+
+    RECT_HIT_PACKET(0, 2, 1, x0, x1, z0, z1)
+
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const override
     {
         bbox = aabb(vec::vec3(x0, z0, k - 0.0001), vec::vec3(x1, z1, k + 0.0001));
@@ -245,12 +537,12 @@ public:
 
     virtual float pdf_value(const vec::vec3 &o, const vec::vec3 &v) const override
     {
-        hit_record rec;
-        if (this->hit(ray(o, v), 0.001, FLT_MAX, rec))
+        float t;
+        if (hit_t(ray(o, v), 0.001, FLT_MAX, t))
         {
             float area = (x1 - x0) * (z1 - z0);
-            float distance_squared = rec.t * rec.t * v.squared_length();
-            float cosine = fabs(vec::dot(v, rec.normal) / v.length());
+            float distance_squared = t * t * v.squared_length();
+            float cosine = fabs(v.y() / v.length()); // normal is the y axis
             return distance_squared / (cosine * area);
         }
         return 0;
@@ -258,7 +550,9 @@ public:
 
     virtual vec::vec3 random(const vec::vec3 &o) const override
     {
-        vec::vec3 random_point = vec::vec3(x0 + rand_float() * (x1 - x0), k, z0 + rand_float() * (z1 - z0));
+        float r1, r2;
+        rand_2d(r1, r2);
+        vec::vec3 random_point = vec::vec3(x0 + r1 * (x1 - x0), k, z0 + r2 * (z1 - z0));
         return random_point - o;
     }
 
@@ -282,7 +576,7 @@ public:
             if (z > z0 && z < z1 && y > y0 && y < y1)
             {
                 rec.point = ray.point_at_parameter(t);
-                rec.mat_ptr = mat_ptr;
+                rec.mat_ptr = mat_ptr.get();
                 rec.normal = vec::vec3(1, 0, 0);
                 rec.u = (y - y0) / (y1 - y0);
                 rec.v = (z - z0) / (z1 - z0);
@@ -293,6 +587,25 @@ public:
         return false;
     }
 
+    // plane distance only, shared by hit_any and pdf_value
+    inline bool hit_t(const ray &ray, float t_min, float t_max, float &t) const
+    {
+        t = (k - ray.origin().x()) / ray.direction().x();
+        if (!(t < t_max && t > t_min))
+            return false;
+        float y = ray.origin().y() + t * ray.direction().y();
+        float z = ray.origin().z() + t * ray.direction().z();
+        return y > y0 && y < y1 && z > z0 && z < z1;
+    }
+
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override
+    {
+        float t;
+        return hit_t(ray, t_min, t_max, t);
+    }
+
+    RECT_HIT_PACKET(1, 2, 0, y0, y1, z0, z1)
+
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const override
     {
         bbox = aabb(vec::vec3(y0, z0, k - 0.0001), vec::vec3(y1, z1, k + 0.0001));
@@ -301,12 +614,12 @@ public:
 
     virtual float pdf_value(const vec::vec3 &o, const vec::vec3 &v) const override
     {
-        hit_record rec;
-        if (this->hit(ray(o, v), 0.001, FLT_MAX, rec))
+        float t;
+        if (hit_t(ray(o, v), 0.001, FLT_MAX, t))
         {
             float area = (y1 - y0) * (z1 - z0);
-            float distance_squared = rec.t * rec.t * v.squared_length();
-            float cosine = fabs(vec::dot(v, rec.normal) / v.length());
+            float distance_squared = t * t * v.squared_length();
+            float cosine = fabs(v.x() / v.length()); // normal is the x axis
             return distance_squared / (cosine * area);
         }
         return 0;
@@ -314,7 +627,9 @@ public:
 
     virtual vec::vec3 random(const vec::vec3 &o) const override
     {
-        vec::vec3 random_point = vec::vec3(k, y0 + rand_float() * (y1 - y0), z0 + rand_float() * (z1 - z0));
+        float r1, r2;
+        rand_2d(r1, r2);
+        vec::vec3 random_point = vec::vec3(k, y0 + r1 * (y1 - y0), z0 + r2 * (z1 - z0));
         return random_point - o;
     }
 
@@ -345,6 +660,11 @@ public:
         return hit_ptr->hit(ray, t_min, t_max, rec);
     }
 
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override
+    {
+        return hit_ptr->hit_any(ray, t_min, t_max);
+    }
+
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const override
     {
         bbox = aabb(pmin, pmax);
@@ -411,7 +731,7 @@ inline bool constant_medium::hit(const ray &ray, float t_min, float t_max, hit_r
                 if (db)
                     std::cerr << "rec.point = " << rec.point << "\n";
                 rec.normal = vec::vec3(1, 0, 0); // arbitrary
-                rec.mat_ptr = phase_function;
+                rec.mat_ptr = phase_function.get();
                 return true;
             }
         }
@@ -1,6 +1,7 @@
 #pragma once
 #include "ray.h"
 #include "aabb.h"
+#include "packet.h"
 
 class material;
 
@@ -11,14 +12,36 @@ struct hit_record
     float v;
     vec::vec3 point;
     vec::vec3 normal;
-    std::shared_ptr<material> mat_ptr;
+    const material *mat_ptr = nullptr; // not owned, the primitive that was hit keeps its material alive
 };
 
 class hitable
 {
 public:
+    virtual ~hitable() = default; // worlds are deleted through hitable pointers
     virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const = 0;
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const = 0;
+    // occlusion query: true as soon as anything is hit in (t_min, t_max), which one and where is never computed
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const
+    {
+        hit_record rec;
+        return hit(ray, t_min, t_max, rec);
+    }
+    // closest hit for the lanes of a packet set in mask: t_max[lane] shrinks and rec[lane] is filled for every lane
+    // that hits, the returned mask says which. the default traces the lanes one at a time
+    virtual int hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const
+    {
+        int hits = 0;
+        for (int lane = 0; lane < ray_packet::size; ++lane)
+        {
+            if (mask >> lane & 1 && hit(packet.rays[lane], t_min, t_max[lane], rec[lane]))
+            {
+                hits |= 1 << lane;
+                t_max[lane] = rec[lane].t;
+            }
+        }
+        return hits;
+    }
     virtual float pdf_value(const vec::vec3 &o, const vec::vec3 &v) const { return 0.0; }
     virtual vec::vec3 random(const vec::vec3 &o) const { return vec::vec3(1, 0, 0); }
 };
@@ -40,6 +63,11 @@ public:
         return false;
     }
 
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override
+    {
+        return ptr->hit_any(ray, t_min, t_max);
+    }
+
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const override
     {
         return ptr->bounding_box(t0, t1, bbox);
@@ -67,6 +95,11 @@ public:
         return false;
     }
 
+    virtual bool hit_any(const ray &_ray, float t_min, float t_max) const override
+    {
+        return hit_ptr->hit_any(ray(_ray.origin() - offset, _ray.direction(), _ray.get_time()), t_min, t_max);
+    }
+
     virtual bool bounding_box(float t0, float t1, aabb &bbox) const override
     {
         if (hit_ptr->bounding_box(t0, t1, bbox))
@@ -89,7 +122,7 @@ public:
     rotate_y(){};
     rotate_y(std::shared_ptr<hitable> hit_ptr, float angle);
 
-    virtual bool hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const override
+    ray rotate_ray(const ray &_ray) const
     {
         vec::vec3 origin = _ray.origin();
         vec::vec3 direction = _ray.direction();
@@ -97,7 +130,12 @@ public:
         origin[2] = sin_theta * _ray.origin()[0] + cos_theta * _ray.origin()[2];
         direction[0] = cos_theta * _ray.direction()[0] - sin_theta * _ray.direction()[2];
         direction[2] = sin_theta * _ray.direction()[0] + cos_theta * _ray.direction()[2];
-        ray rotate_r(origin, direction, _ray.get_time());
+        return ray(origin, direction, _ray.get_time());
+    }
+
+    virtual bool hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const override
+    {
+        ray rotate_r = rotate_ray(_ray);
         if (hit_ptr->hit(rotate_r, t_min, t_max, rec))
         {
             vec::vec3 point = rec.point;
@@ -113,6 +151,11 @@ public:
         return false;
     }
 
+    virtual bool hit_any(const ray &_ray, float t_min, float t_max) const override
+    {
+        return hit_ptr->hit_any(rotate_ray(_ray), t_min, t_max);
+    }
+
     virtual bool bounding_box(float t0, float t1, aabb &box) const override
     {
         box = bbox;
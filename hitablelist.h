@@ -10,6 +10,8 @@ public:
 	hitable_list(std::shared_ptr<hitable>* list, int list_size) : list(list), list_size(list_size){};
 	
 	virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const;
+	virtual bool hit_any(const ray &ray, float t_min, float t_max) const;
+	virtual int hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const;
 	virtual bool bounding_box(float t0, float t1, aabb &bbox) const;
 	float pdf_value(const vec::vec3 &o, const vec::vec3 &v) const;
 	vec::vec3 random(const vec::vec3 &o) const;
@@ -50,6 +52,22 @@ bool hitable_list::hit(const ray &ray, float t_min, float t_max, hit_record &rec
 	return hit_anything;
 }
 
+int hitable_list::hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const
+{
+	int hits = 0;
+	for (int i = 0; i < list_size; i++)
+		hits |= list[i]->hit_packet(packet, mask, t_min, t_max, rec); // t_max shrinks per lane like closest_so_far
+	return hits;
+}
+
+bool hitable_list::hit_any(const ray &ray, float t_min, float t_max) const
+{
+	for (int i = 0; i < list_size; i++)
+		if (list[i]->hit_any(ray, t_min, t_max))
+			return true;
+	return false;
+}
+
 bool hitable_list::bounding_box(float t0, float t1, aabb &bbox) const
 {
 	if (list_size < 1)
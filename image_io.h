@@ -0,0 +1,196 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "framebuffer.h"
+
+// every writer builds the whole file in memory and hands it to the os in one fwrite
+
+inline unsigned char to_byte(float c) // gamma 2, same curve as gamma_correct
+{
+    if (!(c > 0.0f))
+        return 0;
+    if (c >= 1.0f)
+        return 255;
+    return (unsigned char)(255.99f * sqrtf(c));
+}
+
+inline bool write_file(const std::string &path, const std::string &header, const void *data, size_t size)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp)
+    {
+        std::cerr << "can not open " << path << std::endl;
+        return false;
+    }
+    bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size() && fwrite(data, 1, size, fp) == size;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok)
+        std::cerr << "write " << path << " error" << std::endl;
+    return ok;
+}
+
+// binary P6, 8 bit gamma corrected, top row first
+bool write_ppm(const framebuffer &fb, const std::string &path)
+{
+    std::vector<unsigned char> data((size_t)fb.nx * fb.ny * 3);
+    unsigned char *out = data.data();
+    for (int j = fb.ny - 1; j >= 0; --j)
+        for (int i = 0; i < fb.nx; ++i)
+        {
+            const vec::vec3 &c = fb.at(i, j);
+            *out++ = to_byte(c.r());
+            *out++ = to_byte(c.g());
+            *out++ = to_byte(c.b());
+        }
+    std::string header = "P6\n" + std::to_string(fb.nx) + " " + std::to_string(fb.ny) + "\n255\n";
+    return write_file(path, header, data.data(), data.size());
+}
+
+// ascii P3, kept for viewers that only read the old output
+bool write_ppm_ascii(const framebuffer &fb, const std::string &path)
+{
+    std::string text;
+    text.reserve((size_t)fb.nx * fb.ny * 12);
+    char line[32];
+    for (int j = fb.ny - 1; j >= 0; --j)
+        for (int i = 0; i < fb.nx; ++i)
+        {
+            const vec::vec3 &c = fb.at(i, j);
+            int n = snprintf(line, sizeof(line), "%d %d %d\n", to_byte(c.r()), to_byte(c.g()), to_byte(c.b()));
+            text.append(line, n);
+        }
+    std::string header = "P3\n" + std::to_string(fb.nx) + " " + std::to_string(fb.ny) + "\n255\n";
+    return write_file(path, header, text.data(), text.size());
+}
+
+inline bool little_endian()
+{
+    unsigned int one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+// PFM, linear float rgb with no gamma or clamping, rows bottom to top which is the framebuffer's own order
+bool write_pfm(const framebuffer &fb, const std::string &path)
+{
+    static_assert(sizeof(vec::vec3) == 3 * sizeof(float), "vec3 must be packed rgb floats");
+    std::string header = "PF\n" + std::to_string(fb.nx) + " " + std::to_string(fb.ny) + (little_endian() ? "\n-1.0\n" : "\n1.0\n");
+    return write_file(path, header, fb.pixels.data(), fb.pixels.size() * sizeof(vec::vec3));
+}
+
+// tiled linear float layout: a text header "TILEDRGBF\n<nx> <ny> <tile_count>\n", a table of tile_count
+// records {int32 x0, y0, x1, y1, uint64 byte offset}, then every tile's pixels as float rgb rows bottom to top.
+// the file is sized up front and each tile is written in place as soon as it is finished.
+class tiled_writer
+{
+public:
+    tiled_writer() : fp(NULL), failed(false){};
+    ~tiled_writer() { close(); }
+
+    bool open(const std::string &path, int nx, int ny, const std::vector<tile> &tile_list)
+    {
+        tiles = tile_list;
+        fp = fopen(path.c_str(), "wb");
+        if (!fp)
+        {
+            std::cerr << "can not open " << path << std::endl;
+            return false;
+        }
+        std::string header = "TILEDRGBF\n" + std::to_string(nx) + " " + std::to_string(ny) + " " + std::to_string(tiles.size()) + "\n";
+        uint64_t offset = header.size() + tiles.size() * (4 * sizeof(int32_t) + sizeof(uint64_t));
+        std::vector<unsigned char> table;
+        for (const tile &t : tiles)
+        {
+            int32_t rect[4] = {t.x0, t.y0, t.x1, t.y1};
+            offsets.push_back(offset);
+            table.insert(table.end(), (unsigned char *)rect, (unsigned char *)rect + sizeof(rect));
+            table.insert(table.end(), (unsigned char *)&offset, (unsigned char *)&offset + sizeof(offset));
+            offset += (uint64_t)(t.x1 - t.x0) * (t.y1 - t.y0) * sizeof(vec::vec3);
+        }
+        failed = !(fwrite(header.data(), 1, header.size(), fp) == header.size() && fwrite(table.data(), 1, table.size(), fp) == table.size() &&
+                   fflush(fp) == 0 && ftruncate(fileno(fp), (off_t)offset) == 0);
+        if (failed)
+            std::cerr << "write " << path << " error" << std::endl;
+        return !failed;
+    }
+
+    // safe to call from any render thread. a failure is also remembered in failed, for callers that can not act on it
+    bool write_tile(const framebuffer &fb, int index)
+    {
+        const tile &t = tiles[index];
+        std::vector<vec::vec3> data;
+        data.reserve((size_t)(t.x1 - t.x0) * (t.y1 - t.y0));
+        for (int j = t.y0; j < t.y1; ++j)
+            data.insert(data.end(), &fb.at(t.x0, j), &fb.at(t.x0, j) + (t.x1 - t.x0));
+        std::lock_guard<std::mutex> lock(file_mutex);
+        bool ok = fp && fseeko(fp, (off_t)offsets[index], SEEK_SET) == 0 && fwrite(data.data(), sizeof(vec::vec3), data.size(), fp) == data.size();
+        failed = failed || !ok;
+        return ok;
+    }
+
+    bool close()
+    {
+        bool ok = true;
+        if (fp)
+            ok = fclose(fp) == 0;
+        fp = NULL;
+        return ok;
+    }
+
+    FILE *fp;
+    bool failed; // some write went wrong, the file is not usable
+    std::mutex file_mutex;
+    std::vector<tile> tiles;
+    std::vector<uint64_t> offsets;
+};
+
+inline bool known_format(const std::string &format)
+{
+    return format == "ppm" || format == "pfm" || format == "tiled" || format == "p3";
+}
+
+// whole-image write in any of the formats above, tiles only matter for "tiled". the writers report their own errors
+bool write_image(const framebuffer &fb, const std::string &path, const std::string &format, const std::vector<tile> &tiles)
+{
+    if (format == "ppm")
+        return write_ppm(fb, path);
+    if (format == "pfm")
+        return write_pfm(fb, path);
+    if (format == "p3")
+        return write_ppm_ascii(fb, path);
+    if (format == "tiled")
+    {
+        tiled_writer writer;
+        if (!writer.open(path, fb.nx, fb.ny, tiles))
+            return false;
+        bool ok = true;
+        for (int i = 0; ok && i < (int)tiles.size(); ++i)
+            ok = writer.write_tile(fb, i);
+        ok = writer.close() && ok;
+        if (!ok)
+            std::cerr << "write " << path << " error" << std::endl;
+        return ok;
+    }
+    std::cerr << "unknown format " << format << std::endl;
+    return false;
+}
+
+// write next to the target and rename over it, so a viewer or a kill never sees a half written file
+bool write_image_atomic(const framebuffer &fb, const std::string &path, const std::string &format, const std::vector<tile> &tiles)
+{
+    std::string tmp_path = path + ".tmp";
+    if (!write_image(fb, tmp_path, format, tiles))
+        return false;
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "can not rename " << tmp_path << " to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "hitable.h"
+#include "matrix.h"
+#include "sah_node.h"
+#include "transform.h"
+#include "wide_bvh.h"
+
+// one placement of shared geometry under a full affine transform: the shared bottom level (a linear_bvh,
+// triangle_mesh, sphere_set, ...) is traversed in object space. an instance is two matrices, a box and a shared_ptr,
+// whatever the size of the geometry it places
+typedef transform instance;
+
+// top level of the two level structure: a bvh4 over the instances, built with the same sah as the bottom levels.
+// it owns the instances, and through them the shared geometry
+std::shared_ptr<hitable> make_instance_tree(std::vector<std::shared_ptr<hitable>> &instances, float time0 = 0.0f, float time1 = 1.0f)
+{
+    if (instances.empty())
+        return nullptr;
+    return std::shared_ptr<hitable>(new bvh4(std::shared_ptr<hitable>(new sah_node(instances.data(), (int)instances.size(), time0, time1)), time0, time1));
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <typeinfo>
+#include "hitable.h"
+#include "material.h"
+#include "pdf.h"
+
+const int max_depth = 50;		 // hard cap on path length, same as the old recursion limit
+const int roulette_depth = 4;	 // bounces before russian roulette may end a path
+const float max_survival = 0.95f; // even bright paths are cut now and then so dielectric ping-pong ends
+
+// iterative path tracer: throughput carries the product of attenuation * scattering_pdf / pdf of every bounce so far,
+// radiance collects throughput * emitted. after roulette_depth bounces a path survives with probability equal to its
+// brightest throughput channel and survivors are divided by that probability, which keeps the estimate unbiased.
+// first_hit, when given, is the camera ray's hit already found by packet tracing and replaces the first world->hit
+vec::vec3 get_color(const ray &camera_ray, std::shared_ptr<hitable> world, std::shared_ptr<hitable> light_space, int depth, const hit_record *first_hit = NULL)
+{
+	hit_record hrec;
+	scatter_record srec;
+	vec::vec3 radiance(0), throughput(1);
+	ray ray_ = camera_ray, scattered;
+	float pdf_val;
+	if (first_hit)
+		hrec = *first_hit;
+	for (bool hit = first_hit || world->hit(ray_, 0.001, FLT_MAX, hrec); hit; hit = world->hit(ray_, 0.001, FLT_MAX, hrec), ++depth) // a miss adds nothing: darkness
+	{
+		start_bounce(depth - 1); // every bounce draws from its own block of sampler dimensions
+		vec::vec3 emmited = hrec.mat_ptr->emitted(ray_, hrec);		// get emmited color
+		if (depth >= max_depth || !hrec.mat_ptr->scatter(ray_, hrec, srec)) // hit light source
+		{
+			radiance += throughput * emmited;
+			break;
+		}
+
+		if (typeid(lambertian) == typeid(*hrec.mat_ptr->get_class_type()))
+		{
+			const lambertian *temp_ptr = static_cast<const lambertian *>(hrec.mat_ptr);
+			if (typeid(image_texture) == typeid(*temp_ptr->albedo->get_class_type()))
+			{
+				radiance += throughput * srec.attenuation;
+				break;
+			}
+		}
+
+		if (srec.perfect_specular) // perfect reflection of metal, and reflection or refraction of dielectric
+		{
+			throughput *= srec.attenuation;
+			ray_ = srec.scatter_ray;
+		}
+		else
+		{
+			radiance += throughput * emmited;
+			const pdf *cp = srec.pdf_ptr.get(); // cosine pdf, sample
+			if (!light_space)
+			{
+				throughput *= srec.attenuation;
+				ray_ = ray(hrec.point, cp->generate(), ray_.get_time());
+			}
+			else
+			{
+				hitable_pdf hp(light_space.get(), hrec.point); // hitable pdf, sample certain object
+				mixture_pdf p(&hp, cp);						   // mixture pdf, both live on the stack
+
+				scattered = ray(hrec.point, p.generate(), ray_.get_time());
+				pdf_val = p.value(scattered.direction());
+				throughput *= srec.attenuation * hrec.mat_ptr->scattering_pdf(ray_, hrec, scattered) / pdf_val;
+				ray_ = scattered;
+			}
+		}
+
+		if (depth >= roulette_depth)
+		{
+			float survival = std::min(max_survival, std::max(throughput.r(), std::max(throughput.g(), throughput.b())));
+			if (!(rand_float() < survival)) // also ends paths whose throughput went nan
+				break;
+			throughput /= survival;
+		}
+	}
+
+	// skylight, to be added only when the loop ended on a miss
+	// vec::vec3 unit_direction = vec::unit_vector(ray_.direction());
+	// float t = 0.5 * (unit_direction.y() + 1.0); // faded with y
+	// return radiance + throughput * ((1.0 - t) * vec::vec3(1, 1, 1) + t * vec::vec3(0.5, 0.7, 1.0)) * 0.3;
+
+	return radiance;
+}
@@ -0,0 +1,382 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "hitable.h"
+#include "bvh_node.h"
+#include "bvh_node_sp.h"
+#include "sah_node.h"
+
+// 32 bytes, two nodes per cache line. interior nodes store their first child right after themselves,
+// so only the second child's index is kept
+struct alignas(32) linear_bvh_node
+{
+    aabb box;
+    int32_t offset;      // leaf: first index into prims, interior: index of the second child
+    uint16_t prim_count; // 0 for interior nodes
+    uint8_t axis;        // split axis of interior nodes
+    uint8_t pad;
+};
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node must stay 32 bytes");
+
+// what linear_bvh::update did for one frame
+struct bvh_update_stats
+{
+    int refit_nodes = 0;
+    int rebuilt_subtrees = 0;
+    int rebuilt_prims = 0;
+};
+
+// post-build pass: flattens a bvh_node, bvh_node_sp or sah_node tree into one depth-first array and traverses it with an explicit stack
+class linear_bvh : public hitable
+{
+public:
+    static const int max_depth = 64; // traversal stack, the build keeps the tree within it
+
+    linear_bvh(){};
+    linear_bvh(std::shared_ptr<hitable> root, float time0, float time1);
+
+    virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
+    virtual int hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const override;
+    virtual bool bounding_box(float t0, float t1, aabb &bbox) const override;
+
+    // for animation, after the primitives moved: refit recomputes every box bottom up with the topology kept,
+    // update refits and then rebuilds, with the sah, each topmost subtree whose box grew past max_growth times its
+    // surface area when it was built
+    void refit(float time0, float time1);
+    bvh_update_stats update(float time0, float time1, float max_growth = 2.0f);
+
+    std::vector<linear_bvh_node> nodes;
+    std::vector<hitable *> prims;
+    std::vector<float> built_area; // per node, surface area when its subtree was last built
+    std::shared_ptr<hitable> source; // owns the original tree and through it the primitives
+    int depth;
+
+private:
+    int flatten(const hitable *node, float time0, float time1, int level);
+    int add_node(const aabb &box);
+    int subtree_end(int index) const;
+    int rebuild(int index, float time0, float time1);
+    int measure_depth() const;
+    void bound_depth(float time0, float time1);
+};
+
+linear_bvh::linear_bvh(std::shared_ptr<hitable> root, float time0, float time1) : source(root), depth(0)
+{
+    flatten(root.get(), time0, time1, 1);
+    for (const linear_bvh_node &node : nodes)
+        built_area.push_back(surface_area(node.box));
+    bound_depth(time0, time1);
+}
+
+// the traversal stacks hold max_depth levels. a tree that came out deeper (a source that is not depth bounded, or a
+// subtree rebuilt far down by update) is rebuilt whole with the sah, whose median fallback keeps it within them
+void linear_bvh::bound_depth(float time0, float time1)
+{
+    if (depth <= max_depth)
+        return;
+    rebuild(0, time0, time1);
+    depth = measure_depth();
+}
+
+int linear_bvh::add_node(const aabb &box)
+{
+    linear_bvh_node node;
+    node.box = box;
+    node.offset = 0;
+    node.prim_count = 0;
+    node.axis = 0;
+    node.pad = 0;
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+int linear_bvh::flatten(const hitable *node, float time0, float time1, int level)
+{
+    depth = std::max(depth, level);
+    const hitable *left = NULL, *right = NULL;
+    int axis = 0;
+    aabb box;
+    if (const bvh_node *b = dynamic_cast<const bvh_node *>(node))
+        left = b->left, right = b->right, axis = b->axis;
+    else if (const bvh_node_sp *b = dynamic_cast<const bvh_node_sp *>(node))
+        left = b->left.get(), right = b->right.get(), axis = b->axis;
+    else if (const sah_node *b = dynamic_cast<const sah_node *>(node))
+    {
+        if (!b->left) // sah leaves keep their primitive list
+        {
+            int index = add_node(b->bbox);
+            nodes[index].offset = (int32_t)prims.size();
+            nodes[index].prim_count = (uint16_t)b->prim_count;
+            prims.insert(prims.end(), b->prims, b->prims + b->prim_count);
+            return index;
+        }
+        left = b->left, right = b->right, axis = b->axis;
+    }
+
+    if (!left) // any other hitable is a one primitive leaf
+    {
+        if (!node->bounding_box(time0, time1, box))
+            std::cerr << "no bounding box in linear_bvh constructor\n";
+        int index = add_node(box);
+        nodes[index].offset = (int32_t)prims.size();
+        nodes[index].prim_count = 1;
+        prims.push_back(const_cast<hitable *>(node));
+        return index;
+    }
+    if (left == right) // bvh_node with a single primitive points both children at it
+        return flatten(left, time0, time1, level);
+
+    node->bounding_box(time0, time1, box);
+    int index = add_node(box);
+    flatten(left, time0, time1, level + 1);
+    int second = flatten(right, time0, time1, level + 1);
+    nodes[index].offset = second;
+    nodes[index].axis = (uint8_t)axis;
+    return index;
+}
+
+// one past the last node of the subtree at index, the subtree is a contiguous run in depth first order
+int linear_bvh::subtree_end(int index) const
+{
+    while (!nodes[index].prim_count)
+        index = nodes[index].offset;
+    return index + 1;
+}
+
+// children come after their parent, so levels can be handed down in one forward pass
+int linear_bvh::measure_depth() const
+{
+    std::vector<int> level(nodes.size(), 1);
+    int deepest = nodes.empty() ? 0 : 1;
+    for (int index = 0; index < (int)nodes.size(); ++index)
+    {
+        deepest = std::max(deepest, level[index]);
+        if (!nodes[index].prim_count)
+            level[index + 1] = level[nodes[index].offset] = level[index] + 1;
+    }
+    return deepest;
+}
+
+// one backward sweep sees every child before its parent
+void linear_bvh::refit(float time0, float time1)
+{
+    for (int index = (int)nodes.size() - 1; index >= 0; --index)
+    {
+        linear_bvh_node &node = nodes[index];
+        if (!node.prim_count)
+        {
+            node.box = surrounding_box(nodes[index + 1].box, nodes[node.offset].box);
+            continue;
+        }
+        aabb box;
+        bool has_box = false;
+        for (int i = 0; i < node.prim_count; ++i)
+        {
+            aabb prim_box;
+            if (prims[node.offset + i]->bounding_box(time0, time1, prim_box))
+            {
+                box = has_box ? surrounding_box(box, prim_box) : prim_box;
+                has_box = true;
+            }
+        }
+        if (has_box)
+            node.box = box;
+    }
+}
+
+// the subtree's primitives are a contiguous run of prims as well: a fresh sah build over them is flattened and
+// spliced in place of the old nodes, and the second child links that pointed past the old run are shifted.
+// returns the number of primitives rebuilt
+int linear_bvh::rebuild(int index, float time0, float time1)
+{
+    int end = subtree_end(index), first = index;
+    while (!nodes[first].prim_count)
+        ++first;
+    int prim_begin = nodes[first].offset, prim_end = nodes[end - 1].offset + nodes[end - 1].prim_count;
+
+    linear_bvh part;
+    part.depth = 0;
+    {
+        sah_node tree(prims.data() + prim_begin, prim_end - prim_begin, time0, time1);
+        part.flatten(&tree, time0, time1, 1);
+    }
+    for (linear_bvh_node &node : part.nodes)
+        node.offset += node.prim_count ? prim_begin : index;
+    std::copy(part.prims.begin(), part.prims.end(), prims.begin() + prim_begin);
+
+    int shift = (int)part.nodes.size() - (end - index);
+    for (linear_bvh_node &node : nodes)
+        if (!node.prim_count && node.offset >= end)
+            node.offset += shift;
+    nodes.erase(nodes.begin() + index, nodes.begin() + end);
+    nodes.insert(nodes.begin() + index, part.nodes.begin(), part.nodes.end());
+    std::vector<float> part_area;
+    part_area.reserve(part.nodes.size());
+    for (const linear_bvh_node &node : part.nodes)
+        part_area.push_back(surface_area(node.box));
+    built_area.erase(built_area.begin() + index, built_area.begin() + end);
+    built_area.insert(built_area.begin() + index, part_area.begin(), part_area.end());
+    return prim_end - prim_begin;
+}
+
+// walks the nodes in depth first order and skips over each subtree it rebuilds, so only the topmost degraded node
+// on a path is rebuilt. the boxes above it keep their refit bounds, the primitives under them did not change
+bvh_update_stats linear_bvh::update(float time0, float time1, float max_growth)
+{
+    bvh_update_stats stats;
+    refit(time0, time1);
+    stats.refit_nodes = (int)nodes.size();
+    for (int index = 0; index < (int)nodes.size();)
+    {
+        if (nodes[index].prim_count || surface_area(nodes[index].box) <= max_growth * built_area[index])
+        {
+            ++index;
+            continue;
+        }
+        stats.rebuilt_prims += rebuild(index, time0, time1);
+        stats.rebuilt_subtrees++;
+        index = subtree_end(index);
+    }
+    if (stats.rebuilt_subtrees)
+    {
+        depth = measure_depth();
+        bound_depth(time0, time1);
+    }
+    return stats;
+}
+
+bool linear_bvh::hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const
+{
+    if (nodes.empty())
+        return false;
+    int stack[max_depth];
+    int stack_size = 0;
+    int index = 0;
+    bool hit_anything = false;
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[index];
+        if (node.box.hit(_ray, t_min, t_max))
+        {
+            if (node.prim_count)
+            {
+                for (int i = 0; i < node.prim_count; ++i)
+                {
+                    if (prims[node.offset + i]->hit(_ray, t_min, t_max, rec))
+                    {
+                        hit_anything = true;
+                        t_max = rec.t; // everything further away can be skipped now
+                    }
+                }
+            }
+            else
+            {
+                // front to back: descend into the child on the near side of the split, the far one waits on the stack
+                // and its box is tested with t_max already shrunk by whatever the near side hit
+                if (_ray.sign[node.axis])
+                {
+                    stack[stack_size++] = index + 1;
+                    index = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = node.offset;
+                    index = index + 1;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0)
+            break;
+        index = stack[--stack_size];
+    }
+    return hit_anything;
+}
+
+// one traversal for the whole packet: a node is entered with the lanes whose interval still reaches its box, and
+// a lane that found a closer hit drops out of the boxes behind it. the near child is picked by the first active lane,
+// primary rays of a small block all point the same way
+int linear_bvh::hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const
+{
+    if (nodes.empty())
+        return 0;
+    struct entry
+    {
+        int index, mask;
+    };
+    entry stack[max_depth];
+    int stack_size = 0;
+    int index = 0, hits = 0;
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[index];
+        vec::float8 t_near;
+        mask &= hit_box_packet(packet, node.box.min(), node.box.max(), t_min, vec::float8::load(t_max), t_near);
+        if (mask)
+        {
+            if (node.prim_count)
+            {
+                for (int i = 0; i < node.prim_count; ++i)
+                    hits |= prims[node.offset + i]->hit_packet(packet, mask, t_min, t_max, rec);
+            }
+            else
+            {
+                if (packet.rays[__builtin_ctz(mask)].sign[node.axis])
+                {
+                    stack[stack_size++] = entry{index + 1, mask};
+                    index = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = entry{node.offset, mask};
+                    index = index + 1;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0)
+            break;
+        --stack_size;
+        index = stack[stack_size].index;
+        mask = stack[stack_size].mask;
+    }
+    return hits;
+}
+
+bool linear_bvh::hit_any(const ray &_ray, float t_min, float t_max) const
+{
+    if (nodes.empty())
+        return false;
+    int stack[max_depth];
+    int stack_size = 0;
+    int index = 0;
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[index];
+        if (node.box.hit(_ray, t_min, t_max))
+        {
+            if (!node.prim_count)
+            {
+                stack[stack_size++] = node.offset;
+                index = index + 1;
+                continue;
+            }
+            for (int i = 0; i < node.prim_count; ++i)
+                if (prims[node.offset + i]->hit_any(_ray, t_min, t_max))
+                    return true;
+        }
+        if (stack_size == 0)
+            return false;
+        index = stack[--stack_size];
+    }
+}
+
+bool linear_bvh::bounding_box(float t0, float t1, aabb &box) const
+{
+    if (nodes.empty())
+        return false;
+    box = nodes[0].box;
+    return true;
+}
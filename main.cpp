@@ -1,93 +1,146 @@
 #include <fstream>
 #include <iomanip>
-#include <ctime>
+#include <chrono>
+#include <cstring>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <memory>
 #include "scene.cpp"
 #include "pdf.h"
+#include "render.h"
+#include "image_io.h"
+#include "checkpoint.h"
 
-clock_t START_TIME, END_TIME;
+std::chrono::steady_clock::time_point START_TIME, END_TIME; // wall clock, clock() sums cpu time over all render threads
 
-vec::vec3 get_color(const ray &ray_, std::shared_ptr<hitable> world, std::shared_ptr<hitable> light_space, int depth)
+hitable *fun(camera &cam, std::string &fig_name, hitable *(*func_ptr)(camera &cam, std::string &fig_name))
 {
-	hit_record hrec;
-	scatter_record srec;
-	vec::vec3 emmited;
-	std::shared_ptr<pdf> hp, cp, p;
-	ray scattered;
-	float pdf_val;
-	// superclass call implemented superclass virtual methods
-	if (world->hit(ray_, 0.001, FLT_MAX, hrec)) // hitable_list or bvh_node instance, calls its overridden virtual method, get the closest hit object's hrec, which determines how the color of the pixel is calculated
+	return func_ptr(cam, fig_name);
+}
+
+// -w width -h height -s samples -t threads -tile size -seed n -f ppm|pfm|tiled|p3 -sampler independent|stratified|sobol|halton
+// -packets 0|1 (camera rays in packets, on by default) -obj file (render a mesh instead of the solar scene) -instances n (n copies of it)
+// -adaptive threshold (turns adaptive sampling on, -s becomes the cap) -min samples -batch samples
+// -pass samples (turns progressive passes on) -snap passes -snapsec seconds -budget seconds (implies -pass)
+// -checkpoint file (saved with every snapshot and at the end) -resume file (continue from it and keep saving to it)
+// -frames n (an animation of n frames, one file each, needs -obj: the bvh is refit between frames, not rebuilt)
+// false for an unknown option, an option without its value or a value that must not be ignored
+bool parse_args(int argc, char *argv[], render_settings &settings, std::string &format, std::string &checkpoint_path, bool &resume, std::string &obj_path, int &copies, int &frames)
+{
+	for (int i = 1; i < argc; i += 2)
 	{
-		emmited = hrec.mat_ptr->emitted(ray_, hrec);			   // get emmited color
-		if (depth < 50 && hrec.mat_ptr->scatter(ray_, hrec, srec)) // scatter (reflect and refract) happen
+		if (i + 1 == argc)
+		{
+			std::cerr << "option " << argv[i] << " needs a value" << std::endl;
+			return false;
+		}
+		if (!strcmp(argv[i], "-w"))
+			settings.nx = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-h"))
+			settings.ny = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-s"))
+			settings.ns = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-t"))
+			settings.thread_count = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-tile"))
+			settings.tile_size = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-seed"))
+			settings.seed = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+		else if (!strcmp(argv[i], "-f"))
 		{
-			if (typeid(lambertian) == typeid(*hrec.mat_ptr->get_class_type()))
+			if (!known_format(argv[i + 1]))
 			{
-				std::shared_ptr<lambertian> temp_ptr = std::static_pointer_cast<lambertian>(hrec.mat_ptr);
-				// lambertian *temp_ori_ptr = static_cast<typename std::shared_ptr<lambertian>::element_type *>(hrec.mat_ptr.get());
-				// std::shared_ptr<lambertian> temp_ptr = std::shared_ptr<lambertian>(hrec.mat_ptr, temp_ori_ptr);
-
-				if (typeid(image_texture) == typeid(*temp_ptr->albedo->get_class_type()))
-					return srec.attenuation;
+				std::cerr << "unknown format " << argv[i + 1] << std::endl;
+				return false;
 			}
-
-			if (srec.perfect_specular)
-				return srec.attenuation * get_color(srec.scatter_ray, world, light_space, depth + 1); // perfect reflection of metal, and reflection or refraction of dielectric
-
-			cp = srec.pdf_ptr; // cosine pdf, sample
-			if (!light_space)
+			format = argv[i + 1];
+		}
+		else if (!strcmp(argv[i], "-sampler"))
+		{
+			if (!known_sampler(argv[i + 1]))
 			{
-				scattered = ray(hrec.point, cp->generate(), ray_.get_time());
-				return emmited + srec.attenuation * get_color(scattered, world, light_space, depth + 1);
+				std::cerr << "unknown sampler " << argv[i + 1] << std::endl;
+				return false;
 			}
-			hp.reset(new hitable_pdf(light_space, hrec.point)); // hitable pdf, sample certain object
-			p.reset(new mixture_pdf(hp, cp));					// mixture pdf
-
-			scattered = ray(hrec.point, p->generate(), ray_.get_time());
-			pdf_val = p->value(scattered.direction());
-			return emmited + srec.attenuation * hrec.mat_ptr->scattering_pdf(ray_, hrec, scattered) * get_color(scattered, world, light_space, depth + 1) / pdf_val;
-		} // hit light source
+			settings.sampler = argv[i + 1];
+		}
+		else if (!strcmp(argv[i], "-obj"))
+			obj_path = argv[i + 1];
+		else if (!strcmp(argv[i], "-instances"))
+			copies = std::max(1, atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "-frames"))
+			frames = std::max(0, atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "-packets"))
+			settings.packets = atoi(argv[i + 1]) != 0;
+		else if (!strcmp(argv[i], "-adaptive"))
+		{
+			settings.adaptive = true;
+			settings.threshold = (float)atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-min"))
+			settings.min_samples = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-batch"))
+			settings.batch = std::max(1, atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "-pass"))
+		{
+			settings.progressive = true;
+			settings.pass_samples = std::max(1, atoi(argv[i + 1]));
+		}
+		else if (!strcmp(argv[i], "-snap"))
+			settings.snapshot_passes = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-snapsec"))
+			settings.snapshot_seconds = (float)atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "-budget"))
+		{
+			settings.progressive = true;
+			settings.time_budget = (float)atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-checkpoint") || !strcmp(argv[i], "-resume") || !strcmp(argv[i], "--resume"))
+		{
+			settings.progressive = true;
+			checkpoint_path = argv[i + 1];
+			resume = resume || strcmp(argv[i], "-checkpoint");
+		}
 		else
-			return emmited;
-	}
-	else
-	{
-		// skylight
-		// vec::vec3 unit_direction = vec::unit_vector(ray_.direction());
-		// float t = 0.5 * (unit_direction.y() + 1.0); // faded with y
-		// return ((1.0 - t) * vec::vec3(1, 1, 1) + t * vec::vec3(0.5, 0.7, 1.0)) * 0.3;
-
-		// darkness
-		return vec::vec3(0);
+		{
+			std::cerr << "unknown option " << argv[i] << std::endl;
+			return false;
+		}
 	}
-}
-
-void showProgress(int num, int sum)
-{
-	// std::cout << "\n";
-	std::cout << "\r";
-	std::cout << "running: " << (sum - num) * 100 / sum << "%";
-}
-
-hitable *fun(camera &cam, std::string &fig_name, hitable *(*func_ptr)(camera &cam, std::string &fig_name))
-{
-	return func_ptr(cam, fig_name);
+	return true;
 }
 
 int main(int argc, char *argv[])
 {
-	START_TIME = clock();
+	START_TIME = std::chrono::steady_clock::now();
+
+	render_settings settings;
+	std::string format = "ppm", checkpoint_path, obj_path;
+	bool resume = false;
+	int copies = 1, frames = 0;
+	if (!parse_args(argc, argv, settings, format, checkpoint_path, resume, obj_path, copies, frames))
+		return 1;
+	if (frames && obj_path.empty())
+	{
+		std::cerr << "the solar scene has no animation, -frames needs -obj" << std::endl;
+		frames = 0;
+	}
+	if (!checkpoint_path.empty() && settings.snapshot_passes <= 0 && settings.snapshot_seconds <= 0.0f)
+		settings.snapshot_seconds = 60.0f; // checkpoints ride on snapshots, so make sure there are some
 
 	std::string fig_name;
 	camera camera;
 
+	seed_rand(settings.seed); // scene layout is random too
 	int light_count;
 	std::shared_ptr<hitable> light_list[100];
+	animation anim;
 	// hitable *world = TheNextWeek(camera,fig_name);
-	std::shared_ptr<hitable> world(scene::solar(camera, fig_name, light_list, light_count));
+	std::shared_ptr<hitable> world(obj_path.empty() ? scene::solar(camera, fig_name, light_list, light_count)
+												   : scene::obj_model(camera, fig_name, light_list, light_count, obj_path, copies, frames ? &anim : NULL));
+	if (!world)
+		return 1;
 	std::shared_ptr<hitable> hlist(new hitable_list(light_list, light_count));
 
 	std::string file_path = "./output_fig/";
@@ -98,44 +151,86 @@ int main(int argc, char *argv[])
 			std::cerr << "make dir error" << std::endl;
 		}
 	}
-	std::ofstream outfile;
-	outfile.open(file_path + fig_name + "_HD.ppm");
+	std::string out_name = file_path + fig_name + "_HD." + (format == "p3" ? "ppm" : format);
 	// int nx = 400;
 	// int ny = 300;
 	// int ns = 100;
-	int nx = 4096;
-	int ny = 3072;
-	int ns = 1000;
-	outfile << "P3\n"
-			<< nx << " " << ny << "\n255" << std::endl;
-
-	int ir, ig, ib;
-	float u, v;
-	ray ray;
-	vec::vec3 color;
-	for (int j = ny; j >= 0; --j)
+	framebuffer fb(settings.nx, settings.ny);
+	std::vector<tile> tiles = make_tiles(settings.nx, settings.ny, settings.tile_size);
+	if (frames)
 	{
-		showProgress(j, ny);
-		for (int i = 0; i < nx; ++i)
+		if (settings.progressive)
+			std::cerr << "progressive passes are ignored when rendering frames" << std::endl;
+		for (int frame = 0; frame < frames; ++frame)
 		{
-			color.reset();
-			for (int s = 0; s < ns; ++s) // every pixel random generate ray
-			{
-				u = ((float)i + rand_float()) / nx, v = ((float)j + rand_float()) / ny;
-				ray = camera.get_ray(u, v); // ray's time initial wrong to 0, lead to
-
-				color += 1.0 / (float)ns * de_nan(get_color(ray, world, hlist, 1));
-			}
-			color = gamma_correct(color);
-			ir = int(255.99f * color.r());
-			ig = int(255.99f * color.g());
-			ib = int(255.99f * color.b());
-			outfile << ir << " " << ig << " " << ib << std::endl;
+			// the sequence wraps, frame n would be frame 0 again
+			auto start = std::chrono::steady_clock::now();
+			anim.set_time((float)frame / frames);
+			auto moved = std::chrono::steady_clock::now();
+			bvh_update_stats stats = anim.update_bvh(scene::time0, scene::time1);
+			auto updated = std::chrono::steady_clock::now();
+			fb = framebuffer(settings.nx, settings.ny);
+			render(camera, world, hlist, settings, fb);
+			char number[16];
+			snprintf(number, sizeof(number), "_%04d.", frame);
+			if (!write_image(fb, file_path + fig_name + "_HD" + number + (format == "p3" ? "ppm" : format), format, tiles))
+				return 1;
+			std::cout << "frame " << frame << ": move " << std::chrono::duration<double, std::milli>(moved - start).count() << " ms, bvh update "
+					  << std::chrono::duration<double, std::milli>(updated - moved).count() << " ms";
+			if (anim.bvh)
+				std::cout << " (" << stats.refit_nodes << " nodes refit, " << stats.rebuilt_subtrees << " subtrees with " << stats.rebuilt_prims << " of "
+						  << anim.bvh->prims.size() << " prims rebuilt)";
+			std::cout << ", render " << std::chrono::duration<double>(std::chrono::steady_clock::now() - updated).count() << " s" << std::endl;
 		}
 	}
+	else if (settings.progressive)
+	{
+		if (settings.adaptive)
+			std::cerr << "adaptive sampling is ignored in progressive mode" << std::endl;
+		int first_pass = 0;
+		if (resume)
+		{
+			first_pass = load_checkpoint(checkpoint_path, settings, fig_name, fb);
+			if (first_pass < 0)
+				return 1;
+			std::cout << "resuming " << checkpoint_path << " after pass " << first_pass << std::endl;
+		}
+		// a failed periodic snapshot is retried by the next one, only the final one decides the exit code
+		auto snapshot = [&](int pass)
+		{
+			bool ok = write_image_atomic(fb, out_name, format, tiles);
+			if (!checkpoint_path.empty())
+				ok = save_checkpoint(checkpoint_path, settings, fig_name, pass, fb) && ok;
+			return ok;
+		};
+		if (!snapshot(render_progressive(camera, world, hlist, settings, fb, snapshot, first_pass)))
+			return 1;
+	}
+	else if (format == "tiled")
+	{
+		tiled_writer writer;
+		if (!writer.open(out_name, settings.nx, settings.ny, tiles))
+			return 1;
+		render(camera, world, hlist, settings, fb, [&](int index)
+			   { writer.write_tile(fb, index); });
+		if (!writer.close() || writer.failed)
+		{
+			std::cerr << "write " << out_name << " error" << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		render(camera, world, hlist, settings, fb);
+		if (!write_image(fb, out_name, format, tiles))
+			return 1;
+	}
+
+	uint64_t total_samples = fb.total_samples();
+	std::cout << "Samples " << total_samples << " (" << (double)total_samples / ((double)settings.nx * settings.ny) << " spp average)" << std::endl;
 
-	END_TIME = clock();
-	double delta_time = (double)(END_TIME - START_TIME) / CLOCKS_PER_SEC;
+	END_TIME = std::chrono::steady_clock::now();
+	double delta_time = std::chrono::duration<double>(END_TIME - START_TIME).count();
 	std::cout << "Total time " << delta_time << " s" << std::endl;
 	return 0;
 }
\ No newline at end of file
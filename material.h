@@ -10,7 +10,7 @@ struct scatter_record
 	ray scatter_ray;
 	bool perfect_specular;
 	vec::vec3 attenuation; // radiance
-	std::shared_ptr<pdf> pdf_ptr;
+	pdf_storage pdf_ptr; // sampling pdf built in place by scatter, empty for specular materials
 };
 
 vec::vec3 gamma_correct(vec::vec3 col)
@@ -51,7 +51,7 @@ public:
 	{
 		srec.perfect_specular = false;
 		srec.attenuation = albedo->value(hrec.u, hrec.v, hrec.point);
-		srec.pdf_ptr.reset(new cosine_pdf(hrec.normal));
+		srec.pdf_ptr.emplace<cosine_pdf>(hrec.normal);
 		return true;
 	}
 
@@ -96,7 +96,7 @@ public:
 		srec.scatter_ray = ray(hrec.point, reflected + fuzz * random_in_unit_sphere());
 		srec.attenuation = albedo;
 		srec.perfect_specular = true;
-		srec.pdf_ptr = 0;
+		srec.pdf_ptr.reset();
 		return true;
 	}
 
@@ -133,7 +133,7 @@ public:
 	virtual bool scatter(const ray &r_in, const hit_record &hrec, scatter_record &srec) const
 	{
 		srec.perfect_specular = true;
-		srec.pdf_ptr = 0;
+		srec.pdf_ptr.reset();
 		srec.attenuation = vec::vec3(1.0, 1.0, 1.0);
 		vec::vec3 outward_normal;
 		vec::vec3 reflected = reflect(r_in.direction(), hrec.normal);
@@ -189,7 +189,7 @@ public:
 		srec.scatter_ray = ray(hrec.point, random_in_unit_sphere(), ray_in.get_time());
 		srec.attenuation = albedo->value(hrec.u, hrec.v, hrec.point);
 		srec.perfect_specular = false;
-		srec.pdf_ptr.reset(new sphere_pdf());
+		srec.pdf_ptr.emplace<sphere_pdf>();
 		return true;
 	}
 
@@ -0,0 +1,114 @@
+#pragma once
+#include <cmath>
+#include "vec3.h"
+
+namespace vec
+{
+    // affine transform as the top three rows of a 4x4 matrix: a 3x3 linear part in columns 0-2 and the translation
+    // in column 3, the implied last row is 0 0 0 1. points get the translation, vectors do not, normals go through
+    // the inverse transpose of the linear part
+    struct mat3x4
+    {
+        float m[3][4];
+
+        mat3x4()
+        {
+            for (int r = 0; r < 3; ++r)
+                for (int c = 0; c < 4; ++c)
+                    m[r][c] = r == c ? 1.0f : 0.0f;
+        }
+
+        static mat3x4 translate(const vec3 &offset)
+        {
+            mat3x4 t;
+            for (int r = 0; r < 3; ++r)
+                t.m[r][3] = offset[r];
+            return t;
+        }
+
+        static mat3x4 scale(const vec3 &s)
+        {
+            mat3x4 t;
+            for (int r = 0; r < 3; ++r)
+                t.m[r][r] = s[r];
+            return t;
+        }
+
+        // right-handed rotation by angle degrees about axis (rodrigues), for the y axis the same as rotate_y
+        static mat3x4 rotate(const vec3 &axis, float angle)
+        {
+            vec3 a = unit_vector(axis);
+            float radians = (M_PI / 180.) * angle;
+            float s = sin(radians), c = cos(radians), k = 1.0f - c;
+            mat3x4 t;
+            t.m[0][0] = a.x() * a.x() * k + c;
+            t.m[0][1] = a.x() * a.y() * k - a.z() * s;
+            t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+            t.m[1][0] = a.y() * a.x() * k + a.z() * s;
+            t.m[1][1] = a.y() * a.y() * k + c;
+            t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+            t.m[2][0] = a.z() * a.x() * k - a.y() * s;
+            t.m[2][1] = a.z() * a.y() * k + a.x() * s;
+            t.m[2][2] = a.z() * a.z() * k + c;
+            return t;
+        }
+
+        inline vec3 transform_point(const vec3 &p) const
+        {
+            return vec3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+                        m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+                        m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+        }
+
+        inline vec3 transform_vector(const vec3 &v) const
+        {
+            return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                        m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                        m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+        }
+
+        // multiplies by the transpose of the linear part: called on the inverse, this maps normals, not normalized
+        inline vec3 transform_transposed(const vec3 &n) const
+        {
+            return vec3(m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+                        m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+                        m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z());
+        }
+
+        float determinant() const
+        {
+            return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                   m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        }
+
+        // adjugate over determinant for the linear part, then the translation undone. a singular matrix gives inf/nan
+        mat3x4 inverse() const
+        {
+            mat3x4 r;
+            float inv_det = 1.0f / determinant();
+            r.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+            r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+            r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+            r.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+            r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+            r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+            r.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+            r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+            r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+            vec3 t = r.transform_vector(vec3(m[0][3], m[1][3], m[2][3]));
+            for (int i = 0; i < 3; ++i)
+                r.m[i][3] = -t[i];
+            return r;
+        }
+    };
+
+    // a * b applies b first
+    inline mat3x4 operator*(const mat3x4 &a, const mat3x4 &b)
+    {
+        mat3x4 r;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + (j == 3 ? a.m[i][3] : 0.0f);
+        return r;
+    }
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "hitable.h"
+#include "linear_bvh.h"
+#include "sah_node.h"
+
+// indexed triangle mesh: vertex positions, and optionally normals and uvs, are shared buffers indexed per corner, so a
+// triangle costs 12 bytes of indices plus its share of the bvh instead of a heap object per triangle. the mesh keeps
+// its own binned sah bvh over the triangles in linear_bvh_node layout, and the index buffer is reordered at build
+// time so every leaf owns a contiguous run of triangles. one material for the whole mesh
+class triangle_mesh : public hitable
+{
+public:
+    static const int max_depth = 96;   // traversal stack
+    static const int max_sah_depth = 64; // below this, nodes are split at the median to bound the depth
+    // past max_sah_depth every split halves its triangles, and a uint32 indexed mesh halves to one in at most 32 levels
+    static_assert(max_sah_depth + 32 <= max_depth, "a median split mesh must fit the traversal stack");
+
+    triangle_mesh(){};
+    // normals and uvs are either empty or one per position (uvs as u, v pairs), indices hold three per triangle
+    triangle_mesh(std::vector<vec::vec3> positions, std::vector<vec::vec3> normals, std::vector<float> uvs, std::vector<uint32_t> indices,
+                  std::shared_ptr<material> mat_ptr, const sah_settings &settings = sah_settings());
+
+    virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
+    virtual bool bounding_box(float t0, float t1, aabb &bbox) const override;
+
+    int triangle_count() const { return (int)(indices.size() / 3); }
+
+    std::vector<vec::vec3> positions, normals;
+    std::vector<float> uvs;
+    std::vector<uint32_t> indices;
+    std::vector<linear_bvh_node> nodes;
+    std::shared_ptr<material> mat_ptr;
+    int depth = 0;
+
+private:
+    struct triangle_ref // build time only
+    {
+        aabb box;
+        vec::vec3 centroid;
+        uint32_t triangle;
+    };
+    int build(triangle_ref *refs, int begin, int end, const sah_settings &settings, int level);
+    inline bool intersect(const ray &ray, int triangle, float t_min, float t_max, float &t, float &b1, float &b2) const;
+};
+
+triangle_mesh::triangle_mesh(std::vector<vec::vec3> positions, std::vector<vec::vec3> normals, std::vector<float> uvs, std::vector<uint32_t> indices,
+                             std::shared_ptr<material> mat_ptr, const sah_settings &settings)
+    : positions(std::move(positions)), normals(std::move(normals)), uvs(std::move(uvs)), indices(std::move(indices)), mat_ptr(mat_ptr)
+{
+    if (this->normals.size() != this->positions.size())
+        this->normals.clear();
+    if (this->uvs.size() != 2 * this->positions.size())
+        this->uvs.clear();
+    int n = triangle_count();
+    if (!n)
+        return;
+    std::vector<triangle_ref> refs(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const vec::vec3 &p0 = this->positions[this->indices[3 * i]], &p1 = this->positions[this->indices[3 * i + 1]], &p2 = this->positions[this->indices[3 * i + 2]];
+        vec::vec3 lo(std::min(p0.x(), std::min(p1.x(), p2.x())), std::min(p0.y(), std::min(p1.y(), p2.y())), std::min(p0.z(), std::min(p1.z(), p2.z())));
+        vec::vec3 hi(std::max(p0.x(), std::max(p1.x(), p2.x())), std::max(p0.y(), std::max(p1.y(), p2.y())), std::max(p0.z(), std::max(p1.z(), p2.z())));
+        for (int axis = 0; axis < 3; ++axis) // a triangle in an axis plane gets the same slab as the axis aligned rects
+            if (hi[axis] - lo[axis] < 0.0001f)
+            {
+                lo[axis] -= 0.0001f;
+                hi[axis] += 0.0001f;
+            }
+        refs[i].box = aabb(lo, hi);
+        refs[i].centroid = 0.5f * (lo + hi);
+        refs[i].triangle = (uint32_t)i;
+    }
+    nodes.reserve(2 * n / std::max(1, settings.max_leaf_size) + 1);
+    build(refs.data(), 0, n, settings, 1); // depth <= max_depth, see the static_assert
+
+    // leaves point at runs of refs, so put the triangles in refs order
+    std::vector<uint32_t> ordered(this->indices.size());
+    for (int i = 0; i < n; ++i)
+        for (int k = 0; k < 3; ++k)
+            ordered[3 * i + k] = this->indices[3 * refs[i].triangle + k];
+    this->indices.swap(ordered);
+}
+
+// the binned sah of sah_node::build, on triangle references instead of hitables, written depth first into nodes
+int triangle_mesh::build(triangle_ref *refs, int begin, int end, const sah_settings &settings, int level)
+{
+    depth = std::max(depth, level);
+    int n = end - begin;
+    aabb box, centroid_box;
+    sah_bounds(refs + begin, n, box, centroid_box);
+    int index = (int)nodes.size();
+    nodes.push_back(linear_bvh_node{box, begin, 0, 0, 0});
+
+    sah_split split = find_sah_split(refs + begin, n, box, centroid_box, settings);
+    float leaf_cost = settings.intersect_cost * n;
+    // prim_count is 16 bits, so big runs of coincident triangles are split anyway. single triangles never are
+    if (n <= std::min(std::max(1, settings.max_leaf_size), 0xffff) && leaf_cost <= split.cost)
+    {
+        nodes[index].prim_count = (uint16_t)n;
+        return index;
+    }
+    int mid;
+    if (split.axis < 0) // coincident centroids
+        mid = begin + n / 2;
+    else if (level >= max_sah_depth) // a degenerate mesh kept the sah peeling off a few triangles per level
+    {
+        int axis;
+        mid = begin + median_split(refs + begin, n, centroid_box, axis);
+        nodes[index].axis = (uint8_t)axis;
+    }
+    else
+    {
+        mid = begin + partition_sah_split(refs + begin, n, centroid_box, split, settings);
+        nodes[index].axis = (uint8_t)split.axis;
+    }
+    build(refs, begin, mid, settings, level + 1);
+    nodes[index].offset = build(refs, mid, end, settings, level + 1);
+    return index;
+}
+
+// moller-trumbore: t and the barycentrics b1, b2 of the second and third corner, no precomputed edges needed
+inline bool triangle_mesh::intersect(const ray &ray, int triangle, float t_min, float t_max, float &t, float &b1, float &b2) const
+{
+    const vec::vec3 &p0 = positions[indices[3 * triangle]];
+    vec::vec3 e1 = positions[indices[3 * triangle + 1]] - p0;
+    vec::vec3 e2 = positions[indices[3 * triangle + 2]] - p0;
+    vec::vec3 pvec = vec::cross(ray.dir, e2);
+    float det = vec::dot(e1, pvec);
+    if (det == 0.0f) // ray parallel to the triangle's plane
+        return false;
+    float inv_det = 1.0f / det;
+    vec::vec3 tvec = ray.ori - p0;
+    b1 = vec::dot(tvec, pvec) * inv_det;
+    if (b1 < 0.0f || b1 > 1.0f)
+        return false;
+    vec::vec3 qvec = vec::cross(tvec, e1);
+    b2 = vec::dot(ray.dir, qvec) * inv_det;
+    if (b2 < 0.0f || b1 + b2 > 1.0f)
+        return false;
+    t = vec::dot(e2, qvec) * inv_det;
+    return t < t_max && t > t_min;
+}
+
+bool triangle_mesh::hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const
+{
+    if (nodes.empty())
+        return false;
+    int stack[max_depth];
+    int stack_size = 0;
+    int index = 0, closest = -1;
+    float t, b1, b2, hit_b1 = 0.0f, hit_b2 = 0.0f;
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[index];
+        if (node.box.hit(_ray, t_min, t_max))
+        {
+            if (node.prim_count)
+            {
+                for (int i = node.offset; i < node.offset + node.prim_count; ++i)
+                {
+                    if (intersect(_ray, i, t_min, t_max, t, b1, b2))
+                    {
+                        closest = i;
+                        t_max = t;
+                        hit_b1 = b1;
+                        hit_b2 = b2;
+                    }
+                }
+            }
+            else
+            {
+                if (_ray.sign[node.axis])
+                {
+                    stack[stack_size++] = index + 1;
+                    index = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = node.offset;
+                    index = index + 1;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0)
+            break;
+        index = stack[--stack_size];
+    }
+    if (closest < 0)
+        return false;
+
+    // the record is filled once, for the closest triangle only
+    const uint32_t *corner = &indices[3 * closest];
+    float b0 = 1.0f - hit_b1 - hit_b2;
+    rec.t = t_max;
+    rec.point = _ray.point_at_parameter(rec.t);
+    if (!normals.empty())
+        rec.normal = vec::unit_vector(b0 * normals[corner[0]] + hit_b1 * normals[corner[1]] + hit_b2 * normals[corner[2]]);
+    else
+        rec.normal = vec::unit_vector(vec::cross(positions[corner[1]] - positions[corner[0]], positions[corner[2]] - positions[corner[0]]));
+    if (!uvs.empty())
+    {
+        rec.u = b0 * uvs[2 * corner[0]] + hit_b1 * uvs[2 * corner[1]] + hit_b2 * uvs[2 * corner[2]];
+        rec.v = b0 * uvs[2 * corner[0] + 1] + hit_b1 * uvs[2 * corner[1] + 1] + hit_b2 * uvs[2 * corner[2] + 1];
+    }
+    else
+    {
+        rec.u = hit_b1;
+        rec.v = hit_b2;
+    }
+    rec.mat_ptr = mat_ptr.get();
+    return true;
+}
+
+bool triangle_mesh::hit_any(const ray &_ray, float t_min, float t_max) const
+{
+    if (nodes.empty())
+        return false;
+    int stack[max_depth];
+    int stack_size = 0;
+    int index = 0;
+    float t, b1, b2;
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[index];
+        if (node.box.hit(_ray, t_min, t_max))
+        {
+            if (!node.prim_count)
+            {
+                stack[stack_size++] = node.offset;
+                index = index + 1;
+                continue;
+            }
+            for (int i = node.offset; i < node.offset + node.prim_count; ++i)
+                if (intersect(_ray, i, t_min, t_max, t, b1, b2))
+                    return true;
+        }
+        if (stack_size == 0)
+            return false;
+        index = stack[--stack_size];
+    }
+}
+
+bool triangle_mesh::bounding_box(float t0, float t1, aabb &box) const
+{
+    if (nodes.empty())
+        return false;
+    box = nodes[0].box;
+    return true;
+}
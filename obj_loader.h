@@ -0,0 +1,186 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mesh.h"
+
+// streaming wavefront obj reader: the file is read one line at a time and only the geometry is kept (v, vt, vn and f,
+// polygons become triangle fans). groups, objects, smoothing groups and materials are skipped, the mesh gets mat.
+// corners that repeat a v/vt/vn triple share one vertex. normals and uvs are kept only if every corner has them
+namespace obj
+{
+    struct corner_key
+    {
+        int32_t v, vt, vn;
+        bool operator==(const corner_key &o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+    };
+
+    struct corner_hash
+    {
+        size_t operator()(const corner_key &k) const { return ((size_t)(uint32_t)k.v * 0x9e3779b97f4a7c15ULL) ^ ((size_t)(uint32_t)k.vt * 0xbf58476d1ce4e5b9ULL) ^ (uint32_t)k.vn; }
+    };
+
+    // obj indices are 1 based, negative ones count back from the last element read so far. -1 for a missing index
+    inline bool resolve(long index, size_t count, int32_t &out)
+    {
+        if (index > 0 && (size_t)index <= count)
+            out = (int32_t)(index - 1);
+        else if (index < 0 && (size_t)-index <= count)
+            out = (int32_t)(count + index);
+        else
+            return false;
+        return true;
+    }
+
+    // one face corner, "v", "v/vt", "v//vn" or "v/vt/vn", advances p past it
+    inline bool parse_corner(const char *&p, size_t v_count, size_t vt_count, size_t vn_count, corner_key &key)
+    {
+        char *end;
+        key.vt = key.vn = -1;
+        if (!resolve(strtol(p, &end, 10), v_count, key.v))
+            return false;
+        p = end;
+        if (*p == '/')
+        {
+            ++p;
+            if (*p != '/')
+            {
+                if (!resolve(strtol(p, &end, 10), vt_count, key.vt))
+                    return false;
+                p = end;
+            }
+            if (*p == '/')
+            {
+                ++p;
+                if (!resolve(strtol(p, &end, 10), vn_count, key.vn))
+                    return false;
+                p = end;
+            }
+        }
+        return *p == '\0' || isspace((unsigned char)*p);
+    }
+}
+
+// NULL if the file can not be opened or has a malformed face, the message says where
+std::shared_ptr<triangle_mesh> load_obj(const std::string &path, std::shared_ptr<material> mat, const sah_settings &settings = sah_settings())
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    if (!fp)
+    {
+        std::cerr << "can not open " << path << std::endl;
+        return nullptr;
+    }
+    std::vector<vec::vec3> v, vn, positions, normals;
+    std::vector<float> vt, uvs;
+    std::vector<uint32_t> indices;
+    std::vector<int32_t> position_only(0); // vertex of a corner without vt and vn, per v, -1 until used
+    std::unordered_map<obj::corner_key, uint32_t, obj::corner_hash> shared;
+    bool all_uvs = true, all_normals = true;
+    std::vector<uint32_t> polygon;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    long line_number = 0;
+    bool ok = true;
+    while (ok && getline(&line, &capacity, fp) != -1)
+    {
+        ++line_number;
+        const char *p = line;
+        while (*p == ' ' || *p == '\t')
+            ++p;
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            char *end;
+            float x = strtof(p + 2, &end), y = strtof(end, &end), z = strtof(end, &end);
+            v.push_back(vec::vec3(x, y, z));
+            position_only.push_back(-1);
+        }
+        else if (p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            char *end;
+            float s = strtof(p + 3, &end), t = strtof(end, &end);
+            vt.push_back(s);
+            vt.push_back(t);
+        }
+        else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            char *end;
+            float x = strtof(p + 3, &end), y = strtof(end, &end), z = strtof(end, &end);
+            vn.push_back(vec::vec3(x, y, z));
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            polygon.clear();
+            p += 2;
+            while (true)
+            {
+                while (isspace((unsigned char)*p))
+                    ++p;
+                if (!*p)
+                    break;
+                obj::corner_key key;
+                if (!obj::parse_corner(p, v.size(), vt.size() / 2, vn.size(), key))
+                {
+                    std::cerr << path << ":" << line_number << ": bad face corner" << std::endl;
+                    ok = false;
+                    break;
+                }
+                all_uvs = all_uvs && key.vt >= 0;
+                all_normals = all_normals && key.vn >= 0;
+                int32_t *slot = NULL;
+                if (key.vt < 0 && key.vn < 0)
+                    slot = &position_only[key.v];
+                else
+                {
+                    auto found = shared.find(key);
+                    if (found != shared.end())
+                    {
+                        polygon.push_back(found->second);
+                        continue;
+                    }
+                }
+                if (slot && *slot >= 0)
+                {
+                    polygon.push_back((uint32_t)*slot);
+                    continue;
+                }
+                uint32_t vertex = (uint32_t)positions.size();
+                positions.push_back(v[key.v]);
+                normals.push_back(key.vn >= 0 ? vn[key.vn] : vec::vec3(0));
+                uvs.push_back(key.vt >= 0 ? vt[2 * key.vt] : 0.0f);
+                uvs.push_back(key.vt >= 0 ? vt[2 * key.vt + 1] : 0.0f);
+                if (slot)
+                    *slot = (int32_t)vertex;
+                else
+                    shared.emplace(key, vertex);
+                polygon.push_back(vertex);
+            }
+            for (size_t k = 2; ok && k < polygon.size(); ++k)
+            {
+                indices.push_back(polygon[0]);
+                indices.push_back(polygon[k - 1]);
+                indices.push_back(polygon[k]);
+            }
+        }
+    }
+    free(line);
+    fclose(fp);
+    if (!ok)
+        return nullptr;
+    if (indices.empty())
+        std::cerr << path << " has no faces" << std::endl;
+    if (!all_normals)
+        std::vector<vec::vec3>().swap(normals);
+    if (!all_uvs)
+        std::vector<float>().swap(uvs);
+    std::vector<vec::vec3>().swap(v); // the raw buffers are not needed by the bvh build
+    std::vector<vec::vec3>().swap(vn);
+    std::vector<float>().swap(vt);
+    decltype(shared)().swap(shared);
+    return std::make_shared<triangle_mesh>(std::move(positions), std::move(normals), std::move(uvs), std::move(indices), mat, settings);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "simd.h"
+#include "ray.h"
+#include "aabb.h"
+
+// up to 8 coherent rays traced together, kept twice: as scalar rays for per-lane fallbacks and shading, and as
+// structure of arrays for the simd kernels. lanes are selected by an 8 bit mask passed next to the packet
+struct ray_packet
+{
+    static const int size = 8;
+
+    ray rays[size];
+    vec::vec3x8 ori, dir, inv_dir;
+    vec::float8 negative[3]; // per axis, lanes whose direction component is negative
+
+    // fill the simd rows after setting rays[], unused lanes just repeat whatever ray they hold
+    void update()
+    {
+        alignas(32) float lanes[9][size];
+        for (int lane = 0; lane < size; ++lane)
+            for (int i = 0; i < 3; ++i)
+            {
+                lanes[i][lane] = rays[lane].ori[i];
+                lanes[3 + i][lane] = rays[lane].dir[i];
+                lanes[6 + i][lane] = rays[lane].inv_dir[i];
+            }
+        ori = vec::vec3x8(vec::float8::load(lanes[0]), vec::float8::load(lanes[1]), vec::float8::load(lanes[2]));
+        dir = vec::vec3x8(vec::float8::load(lanes[3]), vec::float8::load(lanes[4]), vec::float8::load(lanes[5]));
+        inv_dir = vec::vec3x8(vec::float8::load(lanes[6]), vec::float8::load(lanes[7]), vec::float8::load(lanes[8]));
+        negative[0] = inv_dir.x < vec::float8(0.0f);
+        negative[1] = inv_dir.y < vec::float8(0.0f);
+        negative[2] = inv_dir.z < vec::float8(0.0f);
+    }
+
+    inline const vec::float8 &axis(const vec::vec3x8 &v, int i) const { return i == 0 ? v.x : (i == 1 ? v.y : v.z); }
+};
+
+// the packet against one box, each lane with its own interval [t_min, t_max[lane]]. returns the lanes that hit and
+// their entry distances. the slab distance goes first into max/min so a nan lane keeps its running bound
+inline int hit_box_packet(const ray_packet &packet, const vec::vec3 &bmin, const vec::vec3 &bmax, float t_min, const vec::float8 &t_max, vec::float8 &t_near)
+{
+    vec::float8 near(t_min), far = t_max;
+    for (int i = 0; i < 3; i++)
+    {
+        vec::float8 lo(bmin[i]), hi(bmax[i]);
+        const vec::float8 &o = packet.axis(packet.ori, i), &inv = packet.axis(packet.inv_dir, i);
+        vec::float8 t0 = (vec::select(packet.negative[i], hi, lo) - o) * inv;
+        vec::float8 t1 = (vec::select(packet.negative[i], lo, hi) - o) * inv;
+        near = vec::max(t0, near);
+        far = vec::min(t1, far);
+    }
+    t_near = near;
+    return vec::bits(near < far);
+}
+
+// smallest entry distance over the lanes in mask, used to visit boxes front to back
+inline float nearest_lane(const vec::float8 &t, int mask)
+{
+    alignas(32) float lanes[ray_packet::size];
+    t.store(lanes);
+    float nearest = FLT_MAX;
+    for (int lane = 0; lane < ray_packet::size; ++lane)
+        if (mask >> lane & 1 && lanes[lane] < nearest)
+            nearest = lanes[lane];
+    return nearest;
+}
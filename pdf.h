@@ -1,4 +1,7 @@
 #pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
 #include "vec3.h"
 #include "onb.h"
 #include "rand.h"
@@ -7,6 +10,7 @@
 class pdf
 {
 public:
+    virtual ~pdf() {}
     virtual float value(const vec::vec3 &direction) const = 0;
     virtual vec::vec3 generate() const = 0;
 };
@@ -49,7 +53,7 @@ public:
 class hitable_pdf : public pdf
 {
 public:
-    hitable_pdf(std::shared_ptr<hitable> ptr, const vec::vec3 &origin) : ptr(ptr), origin(origin){};
+    hitable_pdf(const hitable *ptr, const vec::vec3 &origin) : ptr(ptr), origin(origin){};
 
     virtual float value(const vec::vec3 &direction) const override
     {
@@ -61,7 +65,7 @@ public:
     }
 
     vec::vec3 origin;
-    std::shared_ptr<hitable> ptr;
+    const hitable *ptr; // not owned, the scene outlives every pdf built during a sample
 };
 #pragma endregion
 
@@ -69,7 +73,7 @@ public:
 class mixture_pdf : public pdf
 {
 public:
-    mixture_pdf(std::shared_ptr<pdf> p0, std::shared_ptr<pdf> p1)
+    mixture_pdf(const pdf *p0, const pdf *p1)
     {
         p[0] = p0;
         p[1] = p1;
@@ -83,13 +87,53 @@ public:
     }
     virtual vec::vec3 generate() const override
     {
-        if(!p[0])p[1]->generate();
-        if(!p[1])p[0]->generate();
+        if(!p[0])return p[1]->generate();
+        if(!p[1])return p[0]->generate();
         if (rand_float() < 0.5)
             return p[0]->generate();
         return p[1]->generate();
     }
 
-    std::shared_ptr<pdf> p[2];
+    const pdf *p[2]; // not owned, both usually live on the integrator's stack
+};
+#pragma endregion
+
+#pragma region pdf_storage
+// fixed-capacity inline slot for one pdf. materials construct their sampling pdf in place here instead of on the
+// heap, so a bounce costs no malloc/free and no atomic refcount. the get/reset names follow the shared_ptr it replaces
+class pdf_storage
+{
+public:
+    static const size_t capacity = 64;
+
+    pdf_storage() : ptr(NULL) {}
+    ~pdf_storage() { reset(); }
+    pdf_storage(const pdf_storage &) = delete;
+    pdf_storage &operator=(const pdf_storage &) = delete;
+
+    template <class T, class... Args>
+    T *emplace(Args &&...args)
+    {
+        static_assert(sizeof(T) <= capacity, "pdf too large for pdf_storage, raise capacity");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "pdf alignment too large for pdf_storage");
+        reset();
+        T *p = new (buffer) T(std::forward<Args>(args)...);
+        ptr = p;
+        return p;
+    }
+
+    void reset()
+    {
+        if (ptr)
+            ptr->~pdf();
+        ptr = NULL;
+    }
+
+    const pdf *get() const { return ptr; }
+    explicit operator bool() const { return ptr != NULL; }
+
+private:
+    alignas(std::max_align_t) unsigned char buffer[capacity];
+    pdf *ptr;
 };
 #pragma endregion
\ No newline at end of file
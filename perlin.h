@@ -52,11 +52,14 @@ inline float perlin::turb(const vec::vec3 &point, int depth = 7) const
     return fabs(accum);
 }
 
+// noise tables are built during static initialization, so they get a fixed private generator instead of the render threads' ones
+pcg32 perlin_rng(0x5eed, 0x9e71);
+
 inline static float *perlin_generate_float()
 {
     float *p = new float[256];
     for (int i = 0; i < 256; ++i)
-        p[i] = rand_float();
+        p[i] = perlin_rng.next_float();
     return p;
 }
 
@@ -64,7 +67,7 @@ inline static vec::vec3 *perlin_generate_vec3()
 {
     vec::vec3 *p = new vec::vec3[256];
     for (int i = 0; i < 256; ++i)
-        p[i] = vec::unit_vector(vec::vec3(-1 + 2 * rand_float(), -1 + 2 * rand_float(), -1 + 2 * rand_float()));
+        p[i] = vec::unit_vector(vec::vec3(-1 + 2 * perlin_rng.next_float(), -1 + 2 * perlin_rng.next_float(), -1 + 2 * perlin_rng.next_float()));
     return p;
 }
 
@@ -72,7 +75,7 @@ inline void permute(int *p, int n)
 {
     for (int i = n - 1; i > 0; --i)
     {
-        int target = int(rand_float() * (i + 1));
+        int target = int(perlin_rng.next_float() * (i + 1));
         std::swap(p[i], p[target]);
     }
     return;
@@ -1,14 +1,75 @@
 #pragma once
-#include <random>
+#include <cstdint>
 #include "vec3.h"
+#include "sampler.h"
 
-std::random_device rd;
-std::default_random_engine random_engine(rd());
-std::uniform_real_distribution<float> distribution(0, 1);
+// pcg32 (O'Neill, pcg-random.org): 64 bit lcg state, permuted 32 bit output, and a selectable stream so every pixel gets its own independent sequence
+class pcg32
+{
+public:
+	pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+	pcg32(uint64_t init_state, uint64_t init_seq) { seed(init_state, init_seq); }
+
+	void seed(uint64_t init_state, uint64_t init_seq)
+	{
+		state = 0u;
+		inc = (init_seq << 1u) | 1u;
+		next_uint();
+		state += init_state;
+		next_uint();
+	}
+
+	inline uint32_t next_uint()
+	{
+		uint64_t old_state = state;
+		state = old_state * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = (uint32_t)(((old_state >> 18u) ^ old_state) >> 27u);
+		uint32_t rot = (uint32_t)(old_state >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+	}
+
+	inline float next_float() { return (next_uint() >> 8) * 0x1p-24f; } // [0,1), 24 bits fill the float mantissa exactly
+
+	uint64_t state, inc;
+};
+
+inline uint64_t mix_bits(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
 
+thread_local pcg32 rng; // one generator per render thread, no shared state between threads
+
+// next dimension of the installed low-discrepancy sampler, or the next pcg32 number when there is none (or it ran out of dimensions)
 float rand_float()
 {
-	return distribution(random_engine);
+	float u;
+	if (current_sampler && current_sampler->get_1d(u))
+		return u;
+	return rng.next_float();
+}
+
+// two dimensions that belong together (a point on a square), stratified jointly by the samplers that can
+void rand_2d(float &u, float &v)
+{
+	if (current_sampler && current_sampler->get_2d(u, v))
+		return;
+	u = rng.next_float();
+	v = rng.next_float();
+}
+
+// restart the calling thread's sequence, used before building a scene so the same seed gives the same scene
+void seed_rand(uint64_t seed, uint64_t stream = 0)
+{
+	rng.seed(mix_bits(seed), stream);
+}
+
+// every pixel (and every pass over it) owns a stream derived only from its coordinates, so a pixel renders bit-exactly the same whatever tile, thread or order it is rendered in
+void seed_pixel_rand(uint64_t seed, int x, int y, int pass = 0)
+{
+	rng.seed(mix_bits(seed + 0x9e3779b97f4a7c15ULL * (uint64_t)(pass + 1)), ((uint64_t)(uint32_t)y << 32) | (uint32_t)x);
 }
 
 float square_rand_float()
@@ -24,8 +85,8 @@ inline vec::vec3 random_to_sphere(float radius, float distance_squared)
 	x = cos(phi)*sin(theta) = cos(2*Pi*r1)*sqrt(1-z^2)
 	y = sin(phi)*sin(theta) = sin(2*Pi*r1)*sqrt(1-z^2)
 	*/
-	float r1 = rand_float();
-	float r2 = rand_float();
+	float r1, r2;
+	rand_2d(r1, r2);
 	float z = 1 + r2 * (sqrt(1 - radius * radius / distance_squared) - 1);
 	float phi = 2 * M_PI * r1;
 	float x = cos(phi) * sqrt(1 - z * z);
@@ -41,8 +102,8 @@ vec::vec3 random_cosine_direction()
 	x = cos(phi)*sin(theta) = cos(2*Pi*r1)*sqrt(1-z^2) = cos(2*Pi*r1)*sqrt(r2)
 	y = sin(phi)*sin(theta) = sin(2*Pi*r1)*sqrt(1-z^2) = sin(2*Pi*r1)*sqrt(r2)
 	*/
-	float r1 = rand_float();
-	float r2 = rand_float();
+	float r1, r2;
+	rand_2d(r1, r2);
 	float z = sqrt(1 - r2);
 	float phi = 2 * M_PI * r1;
 	float x = cos(phi) * sqrt(r2);
@@ -50,21 +111,30 @@ vec::vec3 random_cosine_direction()
 	return vec::vec3(x, y, z);
 }
 
+// uniform direction (a point on the unit sphere, not inside it): z uniform in [-1,1] and phi uniform, which by
+// archimedes' hat-box theorem covers the sphere with constant density. exactly two random numbers, no rejection
 vec::vec3 random_in_unit_sphere()
 {
-	vec::vec3 p;
-	p = 2 * vec::vec3(rand_float(), rand_float(), rand_float()) - vec::vec3(1, 1, 1);
-	return vec::unit_vector(p);
+	float u, v;
+	rand_2d(u, v);
+	float z = 1 - 2 * u;
+	float r = sqrt(fmaxf(0.0f, 1 - z * z));
+	float phi = 2 * M_PI * v;
+	return vec::vec3(r * cos(phi), r * sin(phi), z);
 }
 
+// concentric mapping (shirley & chiu): squares around the center of [-1,1]^2 go to circles, so strata of the
+// sample square stay compact on the disk. two random numbers, selects instead of a rejection loop
 vec::vec3 random_in_unit_disk()
 {
-	vec::vec3 p;
-	do
-	{
-		p = 2 * vec::vec3(rand_float(), rand_float(), 0) - vec::vec3(1, 1, 0);
-	} while (p.length() >= 1.0);
-	return p;
+	float u, v;
+	rand_2d(u, v);
+	float a = 2 * u - 1, b = 2 * v - 1;
+	bool a_major = fabsf(a) > fabsf(b);
+	float r = a_major ? a : b;
+	float phi = a_major ? float(M_PI / 4) * (b / a) : float(M_PI / 2) - float(M_PI / 4) * (a / b);
+	phi = r != 0 ? phi : 0.0f; // the exact center would divide 0 by 0
+	return vec::vec3(r * cos(phi), r * sin(phi), 0);
 }
 
 void MC_integration_test()
@@ -8,17 +8,31 @@ public:
 		ori = 0.0;
 		dir = vec::vec3();
 		time = 0.0f;
+		set_inverse();
 	};
-	ray(const vec::vec3 &ori, const vec::vec3 &dir) : ori(ori), dir(dir){};
-	ray(const vec::vec3 &ori, const vec::vec3 &dir, float time) : ori(ori), dir(dir), time(time){};
+	ray(const vec::vec3 &ori, const vec::vec3 &dir) : ori(ori), dir(dir), time(0.0f) { set_inverse(); };
+	ray(const vec::vec3 &ori, const vec::vec3 &dir, float time) : ori(ori), dir(dir), time(time) { set_inverse(); };
 
-	vec::vec3 origin() const { return ori; }
-	vec::vec3 direction() const { return dir; }
+	const vec::vec3 &origin() const { return ori; }
+	const vec::vec3 &direction() const { return dir; }
 	float get_time() const { return time; }
 	vec::vec3 point_at_parameter(float t) const { return vec::vec3(ori + dir * t); }
 
-	vec::vec3 ori, dir;
+	// slab tests against boxes need 1/dir and the sign of each component, computed once here instead of per box.
+	// a zero component gives +-inf, which the slab test handles
+	inline void set_inverse()
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			inv_dir[i] = 1.0f / dir[i];
+			sign[i] = inv_dir[i] < 0.0f;
+		}
+	}
+
+	vec::vec3 ori, dir; // call set_inverse() after changing dir in place
 	float time;
+	vec::vec3 inv_dir;
+	int sign[3];
 };
 
 inline vec::vec3 reflect(const vec::vec3 &v, const vec::vec3 &n)
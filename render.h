@@ -0,0 +1,362 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include "camera.h"
+#include "framebuffer.h"
+#include "integrator.h"
+#include "sampler.h"
+
+struct render_settings
+{
+    int nx = 4096;
+    int ny = 3072;
+    int ns = 1000;
+    int tile_size = 32;
+    int thread_count = 0; // 0 means one thread per hardware thread
+    unsigned int seed = 0; // same seed, same image, independent of thread count and tile size
+    std::string sampler = "independent"; // independent, stratified, sobol or halton, see sampler.h
+    // trace camera rays in packets of 4x2 pixels. the image matches one ray at a time only while multiply-adds are not
+    // fused: with fma enabled (-march=native) build with -ffp-contract=off, or the two paths round apart in a few pixels
+    bool packets = true;
+    // adaptive mode: ns is the cap, a pixel stops once it has min_samples and the standard error of its mean
+    // luminance, seen through the output gamma, is below threshold. convergence is checked every batch samples
+    bool adaptive = false;
+    float threshold = 0.005f;
+    int min_samples = 64;
+    int batch = 16;
+    // progressive mode: the image is refined in passes of pass_samples samples over every pixel until ns samples or
+    // time_budget seconds are reached. a snapshot is requested every snapshot_passes passes and/or snapshot_seconds
+    bool progressive = false;
+    int pass_samples = 4;
+    int snapshot_passes = 0;      // 0 disables
+    float snapshot_seconds = 0.0f; // 0 disables
+    float time_budget = 0.0f;      // 0 means no limit, checked between passes
+};
+
+inline float luminance(const vec::vec3 &c) { return 0.2126f * c.r() + 0.7152f * c.g() + 0.0722f * c.b(); }
+
+// running mean and variance of one pixel's sample luminance (welford), numerically stable over thousands of samples
+struct pixel_stats
+{
+    int n = 0;
+    double mean = 0.0, m2 = 0.0;
+
+    inline void add(float x)
+    {
+        ++n;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    // the error is measured after the gamma 2 the writers apply: d(sqrt(L)) = dL / (2 sqrt(L)), so threshold is in
+    // output units (1/255 is one 8 bit step). the mean is floored so black pixels do not divide by zero
+    inline bool converged(float threshold) const
+    {
+        if (n < 2)
+            return false;
+        double standard_error = sqrt(m2 / (n - 1) / n);
+        return standard_error <= threshold * 2.0 * sqrt(std::max(mean, 1e-4));
+    }
+};
+
+void showProgress(int num, int sum)
+{
+    // std::cout << "\n";
+    std::cout << "\r";
+    std::cout << "running: " << (sum - num) * 100 / sum << "%";
+    std::cout.flush();
+}
+
+// tiles in row-major order starting from the top of the image, so progress follows the old scanline order
+std::vector<tile> make_tiles(int nx, int ny, int tile_size)
+{
+    std::vector<tile> tiles;
+    for (int y1 = ny; y1 > 0; y1 -= tile_size)
+        for (int x0 = 0; x0 < nx; x0 += tile_size)
+            tiles.push_back(tile{x0, std::max(0, y1 - tile_size), std::min(nx, x0 + tile_size), y1});
+    return tiles;
+}
+
+// count samples, starting at sample index first, of up to ray_packet::size pixels (lane l is pixel xs[l], ys[l]),
+// added to sums[l]. every sample's camera rays are traced through world as one packet, then each lane is shaded on
+// its own from its primary hit. each pixel keeps its own random stream and sampler state, swapped in around its share
+// of the work, so a pixel draws the same numbers and sums its samples in the same order as the one ray loops
+void render_packet(camera &cam, std::shared_ptr<hitable> world, std::shared_ptr<hitable> light_space, const render_settings &settings,
+                   const int *xs, const int *ys, int lane_count, int pass, uint32_t first, int count, vec::vec3 *sums)
+{
+    pcg32 streams[ray_packet::size];
+    for (int lane = 0; lane < lane_count; ++lane)
+    {
+        seed_pixel_rand(settings.seed, xs[lane], ys[lane], pass);
+        streams[lane] = rng;
+    }
+    // anything random during traversal (constant_medium picks its scattering distance in hit) draws from a stream of
+    // its own instead of a pixel's
+    pcg32 traversal(mix_bits(~(settings.seed + 0x9e3779b97f4a7c15ULL * (uint64_t)(pass + 1))), ((uint64_t)(uint32_t)ys[0] << 32) | (uint32_t)xs[0]);
+    sampler *pixel_sampler = current_sampler;
+    ray_packet packet;
+    hit_record rec[ray_packet::size];
+    alignas(32) float t_max[ray_packet::size];
+    float du, dv;
+    int lanes = (1 << lane_count) - 1;
+    for (int s = 0; s < count; ++s)
+    {
+        for (int lane = 0; lane < lane_count; ++lane)
+        {
+            rng = streams[lane];
+            if (pixel_sampler)
+                pixel_sampler->start_sample(xs[lane], ys[lane], first + s);
+            rand_2d(du, dv);
+            packet.rays[lane] = cam.get_ray(((float)xs[lane] + du) / settings.nx, ((float)ys[lane] + dv) / settings.ny);
+            streams[lane] = rng;
+            t_max[lane] = FLT_MAX;
+        }
+        for (int lane = lane_count; lane < ray_packet::size; ++lane) // idle lanes repeat the first ray and stay masked off
+        {
+            packet.rays[lane] = packet.rays[0];
+            t_max[lane] = FLT_MAX;
+        }
+        packet.update();
+
+        rng = traversal;
+        current_sampler = NULL;
+        int hits = world->hit_packet(packet, lanes, 0.001f, t_max, rec);
+        traversal = rng;
+        current_sampler = pixel_sampler;
+
+        for (int lane = 0; lane < lane_count; ++lane)
+        {
+            if (!(hits >> lane & 1)) // a miss adds nothing, as in get_color
+                continue;
+            rng = streams[lane];
+            if (pixel_sampler)
+                pixel_sampler->start_sample(xs[lane], ys[lane], first + s); // get_color moves on to the bounce dimensions itself
+            sums[lane] += de_nan(get_color(packet.rays[lane], world, light_space, 1, &rec[lane]));
+            streams[lane] = rng;
+        }
+    }
+}
+
+// the tile cut into blocks of 4x2 pixels, one packet lane per pixel. block(xs, ys, lane_count) is called for each
+template <typename F>
+void for_each_packet_block(const tile &t, F block)
+{
+    int xs[ray_packet::size], ys[ray_packet::size];
+    for (int y1 = t.y1; y1 > t.y0; y1 -= 2)
+        for (int x0 = t.x0; x0 < t.x1; x0 += 4)
+        {
+            int lane_count = 0;
+            for (int j = y1 - 1; j >= std::max(t.y0, y1 - 2); --j)
+                for (int i = x0; i < std::min(t.x1, x0 + 4); ++i)
+                {
+                    xs[lane_count] = i;
+                    ys[lane_count++] = j;
+                }
+            block(xs, ys, lane_count);
+        }
+}
+
+void render_tile(camera &cam, std::shared_ptr<hitable> world, std::shared_ptr<hitable> light_space, const render_settings &settings, const tile &t, framebuffer &fb)
+{
+    float u, v, du, dv;
+    ray ray;
+    vec::vec3 color, sample;
+    std::unique_ptr<sampler> pixel_sampler = make_sampler(settings.sampler, settings.ns, settings.seed);
+    current_sampler = pixel_sampler.get();
+    if (settings.packets && !settings.adaptive) // adaptive pixels stop at different counts, they stay one ray at a time
+    {
+        for_each_packet_block(t, [&](const int *xs, const int *ys, int lane_count)
+                              {
+                                  vec::vec3 sums[ray_packet::size];
+                                  for (int lane = 0; lane < lane_count; ++lane)
+                                      sums[lane].reset();
+                                  render_packet(cam, world, light_space, settings, xs, ys, lane_count, 0, 0, settings.ns, sums);
+                                  for (int lane = 0; lane < lane_count; ++lane)
+                                  {
+                                      fb.at(xs[lane], ys[lane]) = settings.ns ? sums[lane] / (float)settings.ns : sums[lane];
+                                      fb.count_at(xs[lane], ys[lane]) = settings.ns;
+                                  } });
+        current_sampler = NULL;
+        return;
+    }
+    for (int j = t.y1 - 1; j >= t.y0; --j)
+    {
+        for (int i = t.x0; i < t.x1; ++i)
+        {
+            color.reset();
+            seed_pixel_rand(settings.seed, i, j);
+            pixel_stats stats;
+            int s = 0;
+            while (s < settings.ns)
+            {
+                int batch_end = settings.adaptive ? std::min(settings.ns, s + settings.batch) : settings.ns;
+                for (; s < batch_end; ++s) // every pixel random generate ray
+                {
+                    if (current_sampler)
+                        current_sampler->start_sample(i, j, s);
+                    rand_2d(du, dv);
+                    u = ((float)i + du) / settings.nx, v = ((float)j + dv) / settings.ny;
+                    ray = cam.get_ray(u, v);
+                    sample = de_nan(get_color(ray, world, light_space, 1));
+                    color += sample;
+                    if (settings.adaptive)
+                        stats.add(luminance(sample));
+                }
+                if (settings.adaptive && s >= settings.min_samples && stats.converged(settings.threshold))
+                    break;
+            }
+            fb.at(i, j) = s ? color / (float)s : color;
+            fb.count_at(i, j) = s;
+        }
+    }
+    current_sampler = NULL;
+}
+
+// run job(index) for every index in [0, job_count) on a pool of threads, each thread takes the next unclaimed index
+// until none are left. job and done are called from the worker threads, done gets the number finished so far
+void parallel_for(int job_count, int thread_count, std::function<void(int)> job, std::function<void(int)> done = nullptr)
+{
+    if (thread_count < 1)
+        thread_count = (int)std::thread::hardware_concurrency();
+    if (thread_count < 1)
+        thread_count = 1;
+
+    std::atomic<int> next_job(0), jobs_done(0);
+    auto worker = [&]()
+    {
+        int index;
+        while ((index = next_job++) < job_count)
+        {
+            job(index);
+            int finished = ++jobs_done;
+            if (done)
+                done(finished);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < thread_count; ++i)
+        pool.emplace_back(worker);
+    worker(); // the calling thread works too
+    for (auto &thread : pool)
+        thread.join();
+}
+
+// render the whole image on a pool of threads, each thread takes the next unrendered tile until none are left.
+// tile_done is called from the worker thread with the index of the tile (in make_tiles order) it just finished
+void render(camera &cam, std::shared_ptr<hitable> world, std::shared_ptr<hitable> light_space, const render_settings &settings, framebuffer &fb,
+            std::function<void(int)> tile_done = nullptr)
+{
+    std::vector<tile> tiles = make_tiles(settings.nx, settings.ny, settings.tile_size);
+    std::mutex progress_mutex;
+    parallel_for((int)tiles.size(), settings.thread_count, [&](int index)
+                 {
+                     render_tile(cam, world, light_space, settings, tiles[index], fb);
+                     if (tile_done)
+                         tile_done(index); },
+                 [&](int done)
+                 {
+                     std::lock_guard<std::mutex> lock(progress_mutex);
+                     showProgress((int)tiles.size() - done, (int)tiles.size()); });
+    std::cout << std::endl;
+}
+
+// one progressive pass over a tile: pass_samples more samples per pixel on top of the running sums. every pass
+// reseeds with its own index, so pass k draws the same numbers whatever passes ran before it or on which thread
+void render_pass_tile(camera &cam, std::shared_ptr<hitable> world, std::shared_ptr<hitable> light_space, const render_settings &settings,
+                      const tile &t, int pass, int samples, framebuffer &fb)
+{
+    float u, v, du, dv;
+    ray ray;
+    std::unique_ptr<sampler> pixel_sampler = make_sampler(settings.sampler, settings.ns, settings.seed);
+    current_sampler = pixel_sampler.get();
+    if (settings.packets)
+    {
+        for_each_packet_block(t, [&](const int *xs, const int *ys, int lane_count)
+                              {
+                                  vec::vec3 sums[ray_packet::size];
+                                  for (int lane = 0; lane < lane_count; ++lane)
+                                      sums[lane] = fb.sum_at(xs[lane], ys[lane]);
+                                  render_packet(cam, world, light_space, settings, xs, ys, lane_count, pass, pass * std::max(1, settings.pass_samples), samples, sums);
+                                  for (int lane = 0; lane < lane_count; ++lane)
+                                  {
+                                      fb.sum_at(xs[lane], ys[lane]) = sums[lane];
+                                      fb.count_at(xs[lane], ys[lane]) += samples;
+                                      fb.at(xs[lane], ys[lane]) = sums[lane] / (float)fb.count_at(xs[lane], ys[lane]);
+                                  } });
+        current_sampler = NULL;
+        return;
+    }
+    for (int j = t.y1 - 1; j >= t.y0; --j)
+    {
+        for (int i = t.x0; i < t.x1; ++i)
+        {
+            seed_pixel_rand(settings.seed, i, j, pass);
+            vec::vec3 &sum = fb.sum_at(i, j);
+            for (int s = 0; s < samples; ++s)
+            {
+                if (current_sampler)
+                    current_sampler->start_sample(i, j, pass * std::max(1, settings.pass_samples) + s);
+                rand_2d(du, dv);
+                u = ((float)i + du) / settings.nx, v = ((float)j + dv) / settings.ny;
+                ray = cam.get_ray(u, v);
+                sum += de_nan(get_color(ray, world, light_space, 1));
+            }
+            fb.count_at(i, j) += samples;
+            fb.at(i, j) = sum / (float)fb.count_at(i, j);
+        }
+    }
+    current_sampler = NULL;
+}
+
+// progressive render: passes over the whole image until every pixel has settings.ns samples or the time budget runs
+// out. snapshot(passes done) is called on the calling thread between passes whenever one is due, so it may read fb
+// freely. first_pass lets a caller continue an accumulation that already holds first_pass passes. returns passes done
+int render_progressive(camera &cam, std::shared_ptr<hitable> world, std::shared_ptr<hitable> light_space, const render_settings &settings,
+                       framebuffer &fb, std::function<void(int)> snapshot = nullptr, int first_pass = 0)
+{
+    typedef std::chrono::steady_clock clock;
+    std::vector<tile> tiles = make_tiles(settings.nx, settings.ny, settings.tile_size);
+    if (fb.sums.empty())
+        fb.sums.resize(fb.pixels.size());
+    int pass_samples = std::max(1, settings.pass_samples);
+    int pass_count = (settings.ns + pass_samples - 1) / pass_samples;
+
+    clock::time_point start = clock::now(), last_snapshot = start;
+    int pass = first_pass, last_snapshot_pass = first_pass;
+    while (pass < pass_count)
+    {
+        int samples = std::min(pass_samples, settings.ns - pass * pass_samples); // last pass tops up to exactly ns
+        parallel_for((int)tiles.size(), settings.thread_count, [&](int index)
+                     { render_pass_tile(cam, world, light_space, settings, tiles[index], pass, samples, fb); });
+        ++pass;
+
+        float elapsed = std::chrono::duration<float>(clock::now() - start).count();
+        std::cout << "\r" << "pass " << pass << "/" << pass_count << ", " << elapsed << " s";
+        std::cout.flush();
+        if (settings.time_budget > 0.0f && elapsed >= settings.time_budget)
+        {
+            std::cout << "\ntime budget of " << settings.time_budget << " s reached";
+            break;
+        }
+        bool due = (settings.snapshot_passes > 0 && pass - last_snapshot_pass >= settings.snapshot_passes) ||
+                   (settings.snapshot_seconds > 0.0f && std::chrono::duration<float>(clock::now() - last_snapshot).count() >= settings.snapshot_seconds);
+        if (due && snapshot && pass < pass_count)
+        {
+            snapshot(pass);
+            last_snapshot = clock::now();
+            last_snapshot_pass = pass;
+        }
+    }
+    std::cout << std::endl;
+    return pass;
+}
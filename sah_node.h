@@ -1,17 +1,271 @@
 #pragma once
+#include <algorithm>
+#include <memory>
+#include <vector>
 #include "hitable.h"
-class sah_node:public hitable{
 
-    sah_node(){};
-    sah_node(hitable **l, int n);
+struct sah_settings
+{
+    int max_leaf_size = 4;       // a node with more primitives than this is always split
+    float traversal_cost = 1.0f; // cost of one box test relative to one primitive test
+    float intersect_cost = 1.0f;
+    int bin_count = 16;
+};
 
-	virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
-	virtual bool bounding_box(float t0, float t1, aabb &bbox) const;
+// per-primitive data the builder needs, computed once at the root instead of calling bounding_box() on every level
+struct sah_primitive
+{
+    hitable *ptr;
+    aabb box;
+    vec::vec3 centroid;
+};
 
-    hitable *left, *right;
-	aabb bbox;
+inline float surface_area(const aabb &box)
+{
+    vec::vec3 d = box.max() - box.min();
+    return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+// the binned sah shared by sah_node and triangle_mesh. Ref is any build reference with box and centroid members
+struct sah_split
+{
+    int axis = -1; // -1: all centroids coincide, nothing to split
+    int bin = 0;   // last bin on the left side
+    float cost = FLT_MAX;
 };
 
-sah_node::sah_node(hitable **l, int n){
-    
+template <typename Ref>
+inline void sah_bounds(const Ref *refs, int n, aabb &box, aabb &centroid_box)
+{
+    box = refs[0].box;
+    centroid_box = aabb(refs[0].centroid, refs[0].centroid);
+    for (int i = 1; i < n; ++i)
+    {
+        box = surrounding_box(box, refs[i].box);
+        centroid_box = surrounding_box(centroid_box, aabb(refs[i].centroid, refs[i].centroid));
+    }
+}
+
+inline int sah_bin(const vec::vec3 &centroid, int axis, const aabb &centroid_box, int bin_count)
+{
+    float lo = centroid_box.min()[axis], extent = centroid_box.max()[axis] - lo;
+    return std::min(bin_count - 1, int(bin_count * (centroid[axis] - lo) / extent));
+}
+
+// cheapest split of refs[0, n) over all three axes
+template <typename Ref>
+sah_split find_sah_split(const Ref *refs, int n, const aabb &box, const aabb &centroid_box, const sah_settings &settings)
+{
+    sah_split best;
+    if (n < 2)
+        return best;
+    const int bin_count = std::max(2, settings.bin_count);
+    std::vector<aabb> bin_box(bin_count), right_box(bin_count);
+    std::vector<int> bin_n(bin_count);
+    float parent_area = surface_area(box);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (centroid_box.max()[axis] - centroid_box.min()[axis] <= 0.0f)
+            continue; // all centroids on one plane, nothing to split
+        std::fill(bin_n.begin(), bin_n.end(), 0);
+        for (int i = 0; i < n; ++i)
+        {
+            int b = sah_bin(refs[i].centroid, axis, centroid_box, bin_count);
+            bin_box[b] = bin_n[b]++ ? surrounding_box(bin_box[b], refs[i].box) : refs[i].box;
+        }
+        // sweep from the right to get the bounds of every right-hand side, then from the left to price every split
+        aabb acc;
+        int acc_n = 0;
+        for (int b = bin_count - 1; b > 0; --b)
+        {
+            if (bin_n[b])
+                acc = acc_n ? surrounding_box(acc, bin_box[b]) : bin_box[b];
+            acc_n += bin_n[b];
+            right_box[b] = acc;
+        }
+        int left_n = 0, right_n = n;
+        for (int b = 0; b < bin_count - 1; ++b)
+        {
+            if (bin_n[b])
+                acc = left_n ? surrounding_box(acc, bin_box[b]) : bin_box[b];
+            left_n += bin_n[b];
+            right_n -= bin_n[b];
+            if (!left_n || !right_n)
+                continue;
+            float cost = settings.traversal_cost + settings.intersect_cost * (surface_area(acc) * left_n + surface_area(right_box[b + 1]) * right_n) / parent_area;
+            if (cost < best.cost)
+            {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = b;
+            }
+        }
+    }
+    return best;
+}
+
+// moves the left side of split to the front, returns its size
+template <typename Ref>
+int partition_sah_split(Ref *refs, int n, const aabb &centroid_box, const sah_split &split, const sah_settings &settings)
+{
+    const int bin_count = std::max(2, settings.bin_count);
+    Ref *mid = std::partition(refs, refs + n, [&](const Ref &r)
+                              { return sah_bin(r.centroid, split.axis, centroid_box, bin_count) <= split.bin; });
+    return int(mid - refs);
+}
+
+// median of refs[0, n) on the widest centroid axis: every level halves n, so depth past the sah levels stays log2(n)
+template <typename Ref>
+int median_split(Ref *refs, int n, const aabb &centroid_box, int &axis)
+{
+    float extent[3];
+    for (int i = 0; i < 3; ++i)
+        extent[i] = centroid_box.max()[i] - centroid_box.min()[i];
+    axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+    int a = axis;
+    std::nth_element(refs, refs + n / 2, refs + n, [a](const Ref &l, const Ref &r)
+                     { return l.centroid[a] < r.centroid[a]; });
+    return n / 2;
+}
+
+// binned surface area heuristic bvh: every axis is cut into bin_count buckets by primitive centroid and the split
+// with the lowest traversal_cost + intersect_cost * (A_left * N_left + A_right * N_right) / A is taken
+class sah_node : public hitable
+{
+public:
+    // below this, nodes are split at the median, which keeps any tree of fewer than 2^31 primitives within the
+    // 64 levels of linear_bvh's traversal stack
+    static const int max_sah_depth = 32;
+
+    sah_node() : left(NULL), right(NULL), prims(NULL), prim_count(0), axis(0) {}
+    sah_node(hitable **l, int n, float time0, float time1, const sah_settings &settings = sah_settings());
+    sah_node(std::shared_ptr<hitable> *l, int n, float time0, float time1, const sah_settings &settings = sah_settings());
+    ~sah_node();
+
+    virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
+    virtual bool bounding_box(float t0, float t1, aabb &bbox) const override;
+
+    sah_node *left, *right; // both NULL for a leaf
+    hitable **prims;        // leaf primitives, not owned
+    int prim_count;
+    int axis;               // split axis of interior nodes
+    aabb bbox;
+    std::vector<std::shared_ptr<hitable>> owned; // the root keeps shared primitives alive
+
+private:
+    void build(sah_primitive *refs, int n, const sah_settings &settings, int level);
+};
+
+inline std::vector<sah_primitive> make_sah_primitives(hitable **l, int n, float time0, float time1)
+{
+    std::vector<sah_primitive> refs(n);
+    for (int i = 0; i < n; ++i)
+    {
+        refs[i].ptr = l[i];
+        if (!l[i]->bounding_box(time0, time1, refs[i].box))
+            std::cerr << "no bounding box in sah_node constructor\n";
+        refs[i].centroid = 0.5f * (refs[i].box.min() + refs[i].box.max());
+    }
+    return refs;
+}
+
+sah_node::sah_node(hitable **l, int n, float time0, float time1, const sah_settings &settings) : left(NULL), right(NULL), prims(NULL), prim_count(0), axis(0)
+{
+    std::vector<sah_primitive> refs = make_sah_primitives(l, n, time0, time1);
+    build(refs.data(), n, settings, 1);
+}
+
+sah_node::sah_node(std::shared_ptr<hitable> *l, int n, float time0, float time1, const sah_settings &settings) : left(NULL), right(NULL), prims(NULL), prim_count(0), axis(0), owned(l, l + n)
+{
+    std::vector<hitable *> raw(n);
+    for (int i = 0; i < n; ++i)
+        raw[i] = l[i].get();
+    std::vector<sah_primitive> refs = make_sah_primitives(raw.data(), n, time0, time1);
+    build(refs.data(), n, settings, 1);
+}
+
+void sah_node::build(sah_primitive *refs, int n, const sah_settings &settings, int level)
+{
+    aabb centroid_box;
+    sah_bounds(refs, n, bbox, centroid_box);
+    sah_split split = find_sah_split(refs, n, bbox, centroid_box, settings);
+    float leaf_cost = settings.intersect_cost * n;
+    if (n <= std::max(1, settings.max_leaf_size) && leaf_cost <= split.cost) // a leaf size below 1 would split single primitives forever
+    {
+        prim_count = n;
+        prims = new hitable *[n];
+        for (int i = 0; i < n; ++i)
+            prims[i] = refs[i].ptr;
+        return;
+    }
+
+    int mid;
+    if (split.axis < 0) // coincident centroids, any split is as good as another
+        mid = n / 2;
+    else if (level >= max_sah_depth) // the sah kept peeling off a few primitives per level
+        mid = median_split(refs, n, centroid_box, axis);
+    else
+    {
+        axis = split.axis;
+        mid = partition_sah_split(refs, n, centroid_box, split, settings);
+    }
+    left = new sah_node();
+    left->build(refs, mid, settings, level + 1);
+    right = new sah_node();
+    right->build(refs + mid, n - mid, settings, level + 1);
+}
+
+sah_node::~sah_node()
+{
+    delete left;
+    delete right;
+    delete[] prims;
+}
+
+bool sah_node::hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const
+{
+    if (!bbox.hit(_ray, t_min, t_max))
+        return false;
+    if (!left)
+    {
+        bool hit_anything = false;
+        float closest_so_far = t_max;
+        for (int i = 0; i < prim_count; i++)
+        {
+            if (prims[i]->hit(_ray, t_min, closest_so_far, rec))
+            {
+                hit_anything = true;
+                closest_so_far = rec.t;
+            }
+        }
+        return hit_anything;
+    }
+    // near child first, its closest hit bounds the far child's interval
+    const sah_node *first = left, *second = right;
+    if (_ray.sign[axis])
+        std::swap(first, second);
+    bool hit_first = first->hit(_ray, t_min, t_max, rec);
+    bool hit_second = second->hit(_ray, t_min, hit_first ? rec.t : t_max, rec);
+    return hit_first || hit_second;
+}
+
+bool sah_node::hit_any(const ray &_ray, float t_min, float t_max) const
+{
+    if (!bbox.hit(_ray, t_min, t_max))
+        return false;
+    if (!left)
+    {
+        for (int i = 0; i < prim_count; i++)
+            if (prims[i]->hit_any(_ray, t_min, t_max))
+                return true;
+        return false;
+    }
+    return left->hit_any(_ray, t_min, t_max) || right->hit_any(_ray, t_min, t_max);
+}
+
+bool sah_node::bounding_box(float t0, float t1, aabb &box) const
+{
+    box = bbox;
+    return true;
 }
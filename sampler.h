@@ -0,0 +1,257 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// low-discrepancy samplers behind rand_float(). a sample of a pixel is a point in a high dimensional cube: dimensions
+// 0-1 are the pixel jitter, 2-3 the lens, 4 the shutter time, and every bounce then owns bounce_dimensions more,
+// starting over at its own base (start_bounce) however many numbers the previous bounce drew. past max_dimension,
+// or with no sampler installed, rand_float() falls back to the thread's pcg32 stream
+class sampler
+{
+public:
+    static const int camera_dimensions = 6;
+    static const int bounce_dimensions = 8;
+    static const int max_dimension = camera_dimensions + 4 * bounce_dimensions; // the first four bounces carry most of the image
+
+    sampler(int sample_count, uint32_t seed) : sample_count(sample_count > 0 ? sample_count : 1), seed(seed), pixel_seed(0), index(0), dimension(0){};
+    virtual ~sampler() {}
+
+    // index counts samples of this pixel over all passes
+    void start_sample(int x, int y, uint32_t sample_index)
+    {
+        pixel_seed = hash(hash(seed ^ hash((uint32_t)x)) ^ (uint32_t)y);
+        index = sample_index;
+        dimension = 0;
+    }
+
+    void start_dimension(int d) { dimension = d; }
+
+    inline bool get_1d(float &u)
+    {
+        if (dimension >= max_dimension)
+            return false;
+        u = sample_1d(dimension++);
+        return true;
+    }
+
+    inline bool get_2d(float &u, float &v)
+    {
+        if (dimension + 1 >= max_dimension)
+            return false;
+        sample_2d(dimension, u, v);
+        dimension += 2;
+        return true;
+    }
+
+    // lowbias32 (Wellons), a cheap full avalanche 32 bit hash
+    static inline uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352dU;
+        x ^= x >> 15;
+        x *= 0x846ca68bU;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static inline float to_float(uint32_t bits) { return (bits >> 8) * 0x1p-24f; } // [0,1) from the top 24 bits
+
+    static inline uint32_t reverse_bits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffU) << 8) | ((x & 0xff00ff00U) >> 8);
+        x = ((x & 0x0f0f0f0fU) << 4) | ((x & 0xf0f0f0f0U) >> 4);
+        x = ((x & 0x33333333U) << 2) | ((x & 0xccccccccU) >> 2);
+        x = ((x & 0x55555555U) << 1) | ((x & 0xaaaaaaaaU) >> 1);
+        return x;
+    }
+
+protected:
+    virtual float sample_1d(int d) = 0;
+    virtual void sample_2d(int d, float &u, float &v)
+    {
+        u = sample_1d(d);
+        v = sample_1d(d + 1);
+    }
+
+    // bijection on [0, n) selected by p (Kensler, "Correlated Multi-Jittered Sampling", 2013)
+    static uint32_t permute(uint32_t i, uint32_t n, uint32_t p)
+    {
+        uint32_t w = n - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do
+        {
+            i ^= p;
+            i *= 0xe170893dU;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3fU;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69U;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303U;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3U;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3dfU;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= n);
+        return (i + p) % n;
+    }
+
+    uint32_t dimension_seed(int d) const { return hash(pixel_seed ^ hash((uint32_t)d + 0x9e3779b9U)); }
+
+    int sample_count; // expected samples per pixel, stratification is laid out for this many
+    uint32_t seed, pixel_seed, index;
+    int dimension;
+};
+
+#pragma region stratified_sampler
+// jittered strata: 1d dimensions split [0,1) into sample_count strata, 2d dimensions into a near-square grid of
+// cells. each dimension visits its strata in its own pseudo-random order (kensler's hashed permutation), so
+// dimensions stay uncorrelated with each other. samples past sample_count start a new round over the strata
+class stratified_sampler : public sampler
+{
+public:
+    stratified_sampler(int sample_count, uint32_t seed) : sampler(sample_count, seed)
+    {
+        columns = (int)ceil(sqrt((double)this->sample_count));
+        rows = (this->sample_count + columns - 1) / columns;
+    }
+
+protected:
+    virtual float sample_1d(int d) override
+    {
+        uint32_t s = dimension_seed(d), round = index / sample_count;
+        uint32_t stratum = permute(index % sample_count, sample_count, s ^ hash(round));
+        return std::min((stratum + jitter(s, 0)) / sample_count, 0x1.fffffep-1f);
+    }
+
+    virtual void sample_2d(int d, float &u, float &v) override
+    {
+        uint32_t s = dimension_seed(d), round = index / sample_count;
+        uint32_t cell = permute(index % sample_count, columns * rows, s ^ hash(round));
+        u = std::min((cell % columns + jitter(s, 0)) / columns, 0x1.fffffep-1f);
+        v = std::min((cell / columns + jitter(s, 1)) / rows, 0x1.fffffep-1f);
+    }
+
+    float jitter(uint32_t s, uint32_t k) const { return to_float(hash(s ^ hash(index * 2 + k))); }
+
+    int columns, rows;
+};
+#pragma endregion
+
+#pragma region sobol_sampler
+// padded (0,2) sobol (Burley, "Practical Hash-based Owen Scrambling", 2020): every 1d or 2d dimension uses the first
+// one or two sobol dimensions, which form a (0,2) sequence, with the sample index shuffled and the result owen
+// scrambled by hashes of the pixel and the dimension. good at any sample count, no direction number tables needed
+class sobol_sampler : public sampler
+{
+public:
+    sobol_sampler(int sample_count, uint32_t seed) : sampler(sample_count, seed){};
+
+protected:
+    virtual float sample_1d(int d) override
+    {
+        uint32_t s = dimension_seed(d);
+        uint32_t shuffled = owen_scramble(index, s);
+        return to_float(owen_scramble(reverse_bits(shuffled), hash(s ^ 0x5bd1e995U)));
+    }
+
+    virtual void sample_2d(int d, float &u, float &v) override
+    {
+        uint32_t s = dimension_seed(d);
+        uint32_t shuffled = owen_scramble(index, s);
+        u = to_float(owen_scramble(reverse_bits(shuffled), hash(s ^ 0x5bd1e995U)));
+        v = to_float(owen_scramble(sobol_1(shuffled), hash(s ^ 0x68e31da4U)));
+    }
+
+    // second sobol dimension, generator matrix built by v ^= v >> 1
+    static uint32_t sobol_1(uint32_t i)
+    {
+        uint32_t result = 0;
+        for (uint32_t v = 1U << 31; i; i >>= 1, v ^= v >> 1)
+            if (i & 1)
+                result ^= v;
+        return result;
+    }
+
+    // nested uniform scramble of a 32 bit fixed point value: the laine-karras hash only carries bits upwards, so it
+    // runs on the reversed value to make every bit depend on the bits above it
+    static uint32_t owen_scramble(uint32_t x, uint32_t s)
+    {
+        x = reverse_bits(x);
+        x += s;
+        x ^= x * 0x6c50b47cU;
+        x ^= x * 0xb82f1e52U;
+        x ^= x * 0xc7afe638U;
+        x ^= x * 0x8d22f6e6U;
+        return reverse_bits(x);
+    }
+};
+#pragma endregion
+
+#pragma region halton_sampler
+// halton: dimension d is the radical inverse of the sample index in the d-th prime. plain halton is badly correlated
+// between neighbouring large primes at low sample counts (i/131 against i/137), so every digit position is remapped
+// with its own random permutation of the digits (random digit scrambling), seeded per pixel and dimension. the
+// permutations also cover the trailing zero digits, which keeps the points from all landing on a coarse grid
+class halton_sampler : public sampler
+{
+public:
+    halton_sampler(int sample_count, uint32_t seed) : sampler(sample_count, seed){};
+
+protected:
+    virtual float sample_1d(int d) override
+    {
+        static const uint32_t primes[max_dimension] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71,
+                                                       73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151, 157, 163};
+        return scrambled_radical_inverse(index, primes[d], dimension_seed(d));
+    }
+
+    static float scrambled_radical_inverse(uint32_t i, uint32_t base, uint32_t s)
+    {
+        double inv_base = 1.0 / base, factor = inv_base, result = 0.0;
+        for (uint32_t position = 0; factor > 0x1p-25; i /= base, factor *= inv_base, ++position) // down to below float precision
+            result += permute(i % base, base, hash(s ^ position)) * factor;
+        return std::min((float)result, 0x1.fffffep-1f);
+    }
+};
+#pragma endregion
+
+thread_local sampler *current_sampler = NULL; // installed by the renderer for the thread's current tile, NULL means plain pcg32
+
+inline bool known_sampler(const std::string &name)
+{
+    return name == "independent" || name == "stratified" || name == "sobol" || name == "halton";
+}
+
+// NULL for "independent" (plain rand_float), otherwise a sampler laid out for sample_count samples per pixel
+std::unique_ptr<sampler> make_sampler(const std::string &name, int sample_count, uint32_t seed)
+{
+    if (name == "stratified")
+        return std::unique_ptr<sampler>(new stratified_sampler(sample_count, seed));
+    if (name == "sobol")
+        return std::unique_ptr<sampler>(new sobol_sampler(sample_count, seed));
+    if (name == "halton")
+        return std::unique_ptr<sampler>(new halton_sampler(sample_count, seed));
+    return nullptr;
+}
+
+// called by the integrator at the start of every bounce (0 is the first surface hit)
+inline void start_bounce(int bounce)
+{
+    if (current_sampler)
+        current_sampler->start_dimension(sampler::camera_dimensions + bounce * sampler::bounce_dimensions);
+}
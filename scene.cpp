@@ -1,4 +1,5 @@
 #pragma once
+#include <chrono>
 #include <string>
 #include "hitablelist.h"
 #include "camera.h"
@@ -8,6 +9,12 @@
 #include "texture.h"
 #include "geometry.h"
 #include "bvh_node_sp.h"
+#include "sah_node.h"
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+#include "obj_loader.h"
+#include "instance.h"
+#include "animation.h"
 #include "map"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -55,7 +62,7 @@ namespace scene
 		std::shared_ptr<material> glass(new dielectric(1.5));
 		list[i++].reset(new sphere(vec::vec3(190, 90, 190), 90, glass));
 		// list[i++].reset(new translate(std::shared_ptr<hitable>(new rotate_y(std::shared_ptr<hitable>(new box(vec::vec3(0, 0, 0), vec::vec3(165, 330, 165), white)), 15)), vec::vec3(265, 0, 295)));
-		std::shared_ptr<hitable> smoke_box(new translate(std::shared_ptr<hitable>(new rotate_y(std::shared_ptr<hitable>(new box(vec::vec3(0, 0, 0), vec::vec3(165, 330, 165), white)), 15)), vec::vec3(265, 0, 295)));
+		std::shared_ptr<hitable> smoke_box = collapse_transforms(std::shared_ptr<hitable>(new translate(std::shared_ptr<hitable>(new rotate_y(std::shared_ptr<hitable>(new box(vec::vec3(0, 0, 0), vec::vec3(165, 330, 165), white)), 15)), vec::vec3(265, 0, 295))));
 		list[i++].reset(new constant_medium(smoke_box, 0.01, std::shared_ptr<texture>(new constant_texture(vec::vec3(1, 1, 1)))));
 
 		return new hitable_list(list, i);
@@ -117,7 +124,7 @@ namespace scene
 		int nx, ny, nn;
 		unsigned char *tex_data = stbi_load("./solar_texture/2k_earth.jpg", &nx, &ny, &nn, 0);
 		std::shared_ptr<material> mat(new lambertian(std::shared_ptr<image_texture>(new image_texture(tex_data, nx, ny, nn))));
-		return new rotate_y(std::shared_ptr<hitable>(new sphere(vec::vec3(0, 0, 0), 2, mat)), 0);
+		return new sphere(vec::vec3(0, 0, 0), 2, mat);
 	}
 
 	hitable *two_perlin_spheres(camera &cam, std::string &fig_name)
@@ -166,6 +173,7 @@ namespace scene
 		int count = 0, bvh_count = 0;
 		std::shared_ptr<hitable> *list = new std::shared_ptr<hitable>[n + 1];
 		std::shared_ptr<hitable> *bvh_list = new std::shared_ptr<hitable>[n + 1];
+		std::vector<sphere> spheres; // the static ones, packed into sphere_sets below
 
 		int nx, ny, nn;
 		unsigned char *tex_data = stbi_load("./solar_texture/2k_stars_milky_way.jpg", &nx, &ny, &nn, 0);
@@ -188,11 +196,11 @@ namespace scene
 					}
 					else if (choose_mat < 0.95)
 					{ // metal
-						bvh_list[bvh_count++].reset(new sphere(center, 0.2, std::shared_ptr<material>(new metal(0.5 * vec::vec3(1 + rand_float(), 1 + rand_float(), 1 + rand_float()), 0.5 * rand_float()))));
+						spheres.push_back(sphere(center, 0.2, std::shared_ptr<material>(new metal(0.5 * vec::vec3(1 + rand_float(), 1 + rand_float(), 1 + rand_float()), 0.5 * rand_float()))));
 					}
 					else
 					{ // glass
-						bvh_list[bvh_count++].reset(new sphere(center, 0.2, std::shared_ptr<material>(new dielectric(1.5))));
+						spheres.push_back(sphere(center, 0.2, std::shared_ptr<material>(new dielectric(1.5))));
 					}
 				}
 			}
@@ -203,11 +211,15 @@ namespace scene
 		list[count++].reset(new sphere(vec::vec3(0, 1, 0), 1.0, std::shared_ptr<material>(new dielectric(1.5))));
 		list[count++].reset(new sphere(vec::vec3(0, 1, 0), -0.95, std::shared_ptr<material>(new dielectric(1.5))));
 		list[count++].reset(new sphere(vec::vec3(4, 1, 0), 1.0, std::shared_ptr<material>(new metal(vec::vec3(0.7, 0.6, 0.5), 0.0))));
-		list[count++].reset(new bvh_node_sp(bvh_list, bvh_count, 0, 1));
+		for (auto &set : make_sphere_sets(spheres))
+			bvh_list[bvh_count++] = set;
+		list[count++].reset(new linear_bvh(std::shared_ptr<hitable>(new sah_node(bvh_list, bvh_count, 0, 1)), 0, 1));
+		// list[count++].reset(new bvh_node_sp(bvh_list, bvh_count, 0, 1));
 
 		// superclass pointer points to child class reference
 		// hitable *world = new hitable_list(list, count); // hitable_list still is a hitable, but list contains sphere
-		hitable *world = new bvh_node_sp(list, count, 0.0, 1.0);
+		// hitable *world = new bvh_node_sp(list, count, 0.0, 1.0);
+		hitable *world = new linear_bvh(std::shared_ptr<hitable>(new sah_node(list, count, 0.0, 1.0)), 0.0, 1.0);
 		return world; // return point to hitable
 	}
 
@@ -223,7 +235,8 @@ namespace scene
 		int n = 500;
 		int count = 0, bvh_count = 0;
 		std::shared_ptr<hitable> *list = new std::shared_ptr<hitable>[n + 1];
-		hitable **bvh_list = new hitable *[n + 1];
+		std::shared_ptr<hitable> *bvh_list = new std::shared_ptr<hitable>[n + 1];
+		std::vector<sphere> spheres; // the static ones, packed into sphere_sets below
 
 		int nx, ny, nn;
 		std::vector<std::string> files;
@@ -263,13 +276,13 @@ namespace scene
 					if (rand_move < 0.1)
 					{
 						vec::vec3 moving_center = center + vec::vec3(0, 0.3 * rand_float(), 0);
-						bvh_list[bvh_count++] = new moving_sphere(center, moving_center, 0.0, 1.0, 0.2, std::shared_ptr<material>(new lambertian(std::shared_ptr<texture>(new constant_texture(vec::vec3(square_rand_float(), square_rand_float(), square_rand_float()))))));
+						bvh_list[bvh_count++].reset(new moving_sphere(center, moving_center, 0.0, 1.0, 0.2, std::shared_ptr<material>(new lambertian(std::shared_ptr<texture>(new constant_texture(vec::vec3(square_rand_float(), square_rand_float(), square_rand_float())))))));
 					}
 					else
 					{
 						img_mat.reset(new lambertian(std::shared_ptr<texture>(new image_texture(tex_data_list[int(files.size() * rand_float())]))));
-						bvh_list[bvh_count++] = new sphere(center, 0.2, img_mat);
-						// bvh_list[bvh_count++] = new sphere(center, 0.2, std::shared_ptr<material>(new lambertian(std::shared_ptr<texture>(new constant_texture(vec::vec3(square_rand_float(), square_rand_float(), square_rand_float()))))));
+						spheres.push_back(sphere(center, 0.2, img_mat));
+						// spheres.push_back(sphere(center, 0.2, std::shared_ptr<material>(new lambertian(std::shared_ptr<texture>(new constant_texture(vec::vec3(square_rand_float(), square_rand_float(), square_rand_float())))))));
 					}
 				}
 				else if (choose_mat < 0.6)
@@ -277,11 +290,11 @@ namespace scene
 					if (rand_move < 0.1)
 					{
 						vec::vec3 moving_center = center + vec::vec3(0, 0.2 * rand_float(), 0);
-						bvh_list[bvh_count++] = new moving_sphere(center, moving_center, 0.0, 1.0, 0.2, std::shared_ptr<material>(new metal(0.5 * vec::vec3(1 + rand_float(), 1 + rand_float(), 1 + rand_float()), 0.5 * rand_float())));
+						bvh_list[bvh_count++].reset(new moving_sphere(center, moving_center, 0.0, 1.0, 0.2, std::shared_ptr<material>(new metal(0.5 * vec::vec3(1 + rand_float(), 1 + rand_float(), 1 + rand_float()), 0.5 * rand_float()))));
 					}
 					else
 					{
-						bvh_list[bvh_count++] = new sphere(center, 0.2, std::shared_ptr<material>(new metal(0.5 * vec::vec3(1 + rand_float(), 1 + rand_float(), 1 + rand_float()), 0.5 * rand_float())));
+						spheres.push_back(sphere(center, 0.2, std::shared_ptr<material>(new metal(0.5 * vec::vec3(1 + rand_float(), 1 + rand_float(), 1 + rand_float()), 0.5 * rand_float()))));
 					}
 				}
 				else
@@ -289,18 +302,21 @@ namespace scene
 					if (rand_move < 0.1)
 					{
 						vec::vec3 moving_center = center + vec::vec3(0, 0.1 * rand_float(), 0);
-						bvh_list[bvh_count++] = new moving_sphere(center, moving_center, 0.0, 1.0, 0.2, std::shared_ptr<material>(new dielectric(1.5)));
+						bvh_list[bvh_count++].reset(new moving_sphere(center, moving_center, 0.0, 1.0, 0.2, std::shared_ptr<material>(new dielectric(1.5))));
 					}
 					else
 					{
-						bvh_list[bvh_count++] = new sphere(center, 0.2, std::shared_ptr<material>(new dielectric(1.5)));
+						spheres.push_back(sphere(center, 0.2, std::shared_ptr<material>(new dielectric(1.5))));
 						if (choose_mat > 0.8)
-							bvh_list[bvh_count++] = new sphere(center, -0.18, std::shared_ptr<material>(new dielectric(1.5)));
+							spheres.push_back(sphere(center, -0.18, std::shared_ptr<material>(new dielectric(1.5))));
 					}
 				}
 			}
 		}
-		list[count++].reset(new bvh_node(bvh_list, bvh_count, 0, 1));
+		for (auto &set : make_sphere_sets(spheres))
+			bvh_list[bvh_count++] = set;
+		list[count++].reset(new linear_bvh(std::shared_ptr<hitable>(new sah_node(bvh_list, bvh_count, 0, 1)), 0, 1));
+		// list[count++].reset(new bvh_node(bvh_list, bvh_count, 0, 1));
 
 		std::shared_ptr<material> strong_light_mat(new diffuse_light(std::shared_ptr<texture>(new constant_texture(vec::vec3(10)))));
 		std::shared_ptr<material> weak_light_mat(new diffuse_light(std::shared_ptr<texture>(new constant_texture(vec::vec3(5)))));
@@ -317,8 +333,10 @@ namespace scene
 		light_list[light_count++] = sphere_list[2]; 
 
 		// superclass pointer points to child class reference
-		hitable *world = new hitable_list(list, count); // hitable_list still is a hitable, but list contains sphere
-		return world;									// return point to hitable
+		// hitable *world = new hitable_list(list, count); // hitable_list still is a hitable, but list contains sphere
+		// hitable *world = new linear_bvh(std::shared_ptr<hitable>(new sah_node(list, count, 0.0, 1.0)), 0.0, 1.0); // with near-first traversal the big spheres no longer cost a full second descent
+		hitable *world = new bvh4(std::shared_ptr<hitable>(new sah_node(list, count, 0.0, 1.0)), 0.0, 1.0);
+		return world; // return point to hitable
 	}
 
 	// big ball left, no problem,otherwise double layer glass refract wrong (no refract just reflect)
@@ -346,4 +364,85 @@ namespace scene
 		// hitable *world = new bvh_node(list, count, 0.0, 1.0);
 		return world; // return point to hitable
 	}
+
+	// a mesh from an obj file in grey on a floor, lit by one sphere light, the camera framed on the mesh's bounds.
+	// copies > 1 places that many instances of the one mesh on a grid, each turned and scaled at random, under a
+	// top level bvh. with anim the scene moves over the sequence: a single mesh makes one turn on a turntable, instances
+	// spin in place while the grid swirls about its center, inner ones furthest, under a linear_bvh that anim refits.
+	// NULL if the file can not be loaded
+	hitable *obj_model(camera &cam, std::string &fig_name, std::shared_ptr<hitable> *light_list, int &light_count, const std::string &path, int copies = 1, animation *anim = NULL)
+	{
+		size_t slash = path.find_last_of('/'), dot = path.find_last_of('.');
+		size_t start = slash == std::string::npos ? 0 : slash + 1;
+		fig_name = path.substr(start, dot == std::string::npos || dot < start ? std::string::npos : dot - start);
+
+		std::shared_ptr<material> gray(new lambertian(std::shared_ptr<texture>(new constant_texture(vec::vec3(0.73, 0.73, 0.73)))));
+		std::shared_ptr<triangle_mesh> mesh = load_obj(path, gray);
+		aabb bounds;
+		if (!mesh || !mesh->bounding_box(0, 1, bounds))
+			return NULL;
+		std::cout << path << ": " << mesh->triangle_count() << " triangles, " << mesh->positions.size() << " vertices, bvh depth " << mesh->depth << std::endl;
+		std::shared_ptr<hitable> model = mesh;
+		vec::vec3 mesh_center = 0.5 * (bounds.min() + bounds.max()), pivot(mesh_center.x(), bounds.min().y(), mesh_center.z());
+		if (copies > 1)
+		{
+			vec::vec3 extent = bounds.max() - bounds.min();
+			float spacing = 1.2 * std::max(extent.x(), extent.z()) * sqrt(2.0); // room for any turn about y
+			int side = (int)ceil(sqrt((double)copies));
+			float grid_radius = spacing * side;
+			std::vector<std::shared_ptr<hitable>> instances;
+			for (int i = 0; i < copies; ++i)
+			{
+				float scale = 0.6 + 0.4 * rand_float(), turn = 360 * rand_float();
+				vec::vec3 place((i % side - 0.5 * (side - 1)) * spacing, 0, (i / side - 0.5 * (side - 1)) * spacing);
+				float swirl = 180 * (1 - place.length() / grid_radius), spin = i % 2 ? 360 : -360;
+				// rest on the floor at y = bounds.min().y(), centered on its grid cell
+				animation::motion path = [=](float t)
+				{
+					vec::vec3 at = vec::mat3x4::rotate(vec::vec3(0, 1, 0), swirl * t).transform_vector(place);
+					return vec::mat3x4::translate(at + pivot) * vec::mat3x4::rotate(vec::vec3(0, 1, 0), turn + spin * t) * vec::mat3x4::scale(vec::vec3(scale)) * vec::mat3x4::translate(-pivot);
+				};
+				std::shared_ptr<transform> placed(new instance(mesh, path(0)));
+				if (anim)
+					anim->add(placed, path);
+				instances.push_back(placed);
+			}
+			if (anim)
+			{
+				auto start = std::chrono::steady_clock::now();
+				anim->bvh.reset(new linear_bvh(std::shared_ptr<hitable>(new sah_node(instances.data(), (int)instances.size(), time0, time1)), time0, time1));
+				std::cout << "top level bvh built in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+				model = anim->bvh;
+			}
+			else
+				model = make_instance_tree(instances);
+			model->bounding_box(0, 1, bounds);
+			std::cout << copies << " instances, " << (long long)copies * mesh->triangle_count() << " triangles placed" << std::endl;
+		}
+		else if (anim)
+		{
+			std::shared_ptr<transform> turntable(new transform(mesh, vec::mat3x4()));
+			anim->add(turntable, [=](float t)
+					  { return vec::mat3x4::translate(pivot) * vec::mat3x4::rotate(vec::vec3(0, 1, 0), 360 * t) * vec::mat3x4::translate(-pivot); });
+			model = turntable;
+		}
+
+		vec::vec3 center = 0.5 * (bounds.min() + bounds.max());
+		float radius = 0.5 * (bounds.max() - bounds.min()).length();
+		float distance = radius / tan(vfov * M_PI / 360) * 1.1; // the bounding sphere fills the vertical field of view
+		vec::vec3 lookfrom = center + distance * vec::unit_vector(vec::vec3(0.6, 0.4, 1));
+		cam = camera(lookfrom, center, vup, vfov, aspect, aperture, time0, time1);
+
+		std::shared_ptr<hitable> *list = new std::shared_ptr<hitable>[3];
+		int count = 0;
+		std::shared_ptr<material> floor(new lambertian(std::shared_ptr<texture>(new constant_texture(vec::vec3(0.5, 0.5, 0.5)))));
+		std::shared_ptr<material> light(new diffuse_light(std::shared_ptr<texture>(new constant_texture(vec::vec3(15, 15, 15)))));
+		std::shared_ptr<hitable> lamp(new sphere(center + radius * vec::vec3(1.5, 3, 2), 0.5 * radius, light));
+		list[count++] = model;
+		list[count++].reset(new xz_rect(center.x() - 20 * radius, center.z() - 20 * radius, center.x() + 20 * radius, center.z() + 20 * radius, bounds.min().y(), floor));
+		list[count++] = lamp;
+		light_count = 0;
+		light_list[light_count++] = lamp;
+		return new hitable_list(list, count);
+	}
 }
@@ -0,0 +1,355 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+#include "vec3.h"
+
+// simd counterparts of vec3: vec4 keeps one vector in an sse register, float8 / vec3x8 hold 8 floats / 8 vectors
+// as structure of arrays so one kernel runs on 8 rays or 8 primitives at a time. float8 is one __m256 when built with
+// -mavx, two __m128 halves with plain sse2 and an array the compiler may vectorize otherwise, so code written against
+// it runs everywhere.
+// comparisons return a float8 mask with all bits set in the true lanes, consumed by select, any, all and bits
+namespace vec
+{
+#pragma region float8
+    struct alignas(32) float8
+    {
+#if defined(__AVX__)
+        __m256 m;
+        float8() {}
+        float8(__m256 m) : m(m) {}
+        float8(float x) : m(_mm256_set1_ps(x)) {}
+        static inline float8 load(const float *p) { return _mm256_loadu_ps(p); }
+        inline void store(float *p) const { _mm256_storeu_ps(p, m); }
+        inline float operator[](int i) const
+        {
+            alignas(32) float lanes[8];
+            _mm256_store_ps(lanes, m);
+            return lanes[i];
+        }
+#elif defined(__SSE2__)
+        __m128 m[2]; // lanes 0-3, 4-7
+        float8() {}
+        float8(__m128 lo, __m128 hi) : m{lo, hi} {}
+        float8(float x) : m{_mm_set1_ps(x), _mm_set1_ps(x)} {}
+        static inline float8 load(const float *p) { return float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+        inline void store(float *p) const
+        {
+            _mm_storeu_ps(p, m[0]);
+            _mm_storeu_ps(p + 4, m[1]);
+        }
+        inline float operator[](int i) const
+        {
+            alignas(16) float lanes[8];
+            store(lanes);
+            return lanes[i];
+        }
+#else
+        float m[8];
+        float8() {}
+        float8(float x)
+        {
+            for (int i = 0; i < 8; ++i)
+                m[i] = x;
+        }
+        static inline float8 load(const float *p)
+        {
+            float8 r;
+            memcpy(r.m, p, sizeof(r.m));
+            return r;
+        }
+        inline void store(float *p) const { memcpy(p, m, sizeof(m)); }
+        inline float operator[](int i) const { return m[i]; }
+#endif
+        inline float8 &operator+=(const float8 &b);
+        inline float8 &operator-=(const float8 &b);
+        inline float8 &operator*=(const float8 &b);
+        inline float8 &operator/=(const float8 &b);
+    };
+
+#if defined(__AVX__)
+    inline float8 operator+(const float8 &a, const float8 &b) { return _mm256_add_ps(a.m, b.m); }
+    inline float8 operator-(const float8 &a, const float8 &b) { return _mm256_sub_ps(a.m, b.m); }
+    inline float8 operator*(const float8 &a, const float8 &b) { return _mm256_mul_ps(a.m, b.m); }
+    inline float8 operator/(const float8 &a, const float8 &b) { return _mm256_div_ps(a.m, b.m); }
+    inline float8 operator-(const float8 &a) { return _mm256_xor_ps(a.m, _mm256_set1_ps(-0.0f)); }
+    inline float8 min(const float8 &a, const float8 &b) { return _mm256_min_ps(a.m, b.m); }
+    inline float8 max(const float8 &a, const float8 &b) { return _mm256_max_ps(a.m, b.m); }
+    inline float8 sqrt(const float8 &a) { return _mm256_sqrt_ps(a.m); }
+    inline float8 abs(const float8 &a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.m); }
+    inline float8 operator<(const float8 &a, const float8 &b) { return _mm256_cmp_ps(a.m, b.m, _CMP_LT_OQ); }
+    inline float8 operator<=(const float8 &a, const float8 &b) { return _mm256_cmp_ps(a.m, b.m, _CMP_LE_OQ); }
+    inline float8 operator>(const float8 &a, const float8 &b) { return _mm256_cmp_ps(a.m, b.m, _CMP_GT_OQ); }
+    inline float8 operator>=(const float8 &a, const float8 &b) { return _mm256_cmp_ps(a.m, b.m, _CMP_GE_OQ); }
+    inline float8 operator&(const float8 &a, const float8 &b) { return _mm256_and_ps(a.m, b.m); }
+    inline float8 operator|(const float8 &a, const float8 &b) { return _mm256_or_ps(a.m, b.m); }
+    inline float8 select(const float8 &mask, const float8 &a, const float8 &b) { return _mm256_blendv_ps(b.m, a.m, mask.m); } // mask ? a : b
+    inline int bits(const float8 &mask) { return _mm256_movemask_ps(mask.m); }
+#elif defined(__SSE2__)
+    // without avx, but sse2 is always there on x86-64: every operation runs on the two 4 lane halves
+    inline float8 operator+(const float8 &a, const float8 &b) { return float8(_mm_add_ps(a.m[0], b.m[0]), _mm_add_ps(a.m[1], b.m[1])); }
+    inline float8 operator-(const float8 &a, const float8 &b) { return float8(_mm_sub_ps(a.m[0], b.m[0]), _mm_sub_ps(a.m[1], b.m[1])); }
+    inline float8 operator*(const float8 &a, const float8 &b) { return float8(_mm_mul_ps(a.m[0], b.m[0]), _mm_mul_ps(a.m[1], b.m[1])); }
+    inline float8 operator/(const float8 &a, const float8 &b) { return float8(_mm_div_ps(a.m[0], b.m[0]), _mm_div_ps(a.m[1], b.m[1])); }
+    inline float8 operator-(const float8 &a) { return float8(_mm_xor_ps(a.m[0], _mm_set1_ps(-0.0f)), _mm_xor_ps(a.m[1], _mm_set1_ps(-0.0f))); }
+    inline float8 min(const float8 &a, const float8 &b) { return float8(_mm_min_ps(a.m[0], b.m[0]), _mm_min_ps(a.m[1], b.m[1])); }
+    inline float8 max(const float8 &a, const float8 &b) { return float8(_mm_max_ps(a.m[0], b.m[0]), _mm_max_ps(a.m[1], b.m[1])); }
+    inline float8 sqrt(const float8 &a) { return float8(_mm_sqrt_ps(a.m[0]), _mm_sqrt_ps(a.m[1])); }
+    inline float8 abs(const float8 &a) { return float8(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.m[0]), _mm_andnot_ps(_mm_set1_ps(-0.0f), a.m[1])); }
+    inline float8 operator<(const float8 &a, const float8 &b) { return float8(_mm_cmplt_ps(a.m[0], b.m[0]), _mm_cmplt_ps(a.m[1], b.m[1])); }
+    inline float8 operator<=(const float8 &a, const float8 &b) { return float8(_mm_cmple_ps(a.m[0], b.m[0]), _mm_cmple_ps(a.m[1], b.m[1])); }
+    inline float8 operator>(const float8 &a, const float8 &b) { return float8(_mm_cmpgt_ps(a.m[0], b.m[0]), _mm_cmpgt_ps(a.m[1], b.m[1])); }
+    inline float8 operator>=(const float8 &a, const float8 &b) { return float8(_mm_cmpge_ps(a.m[0], b.m[0]), _mm_cmpge_ps(a.m[1], b.m[1])); }
+    inline float8 operator&(const float8 &a, const float8 &b) { return float8(_mm_and_ps(a.m[0], b.m[0]), _mm_and_ps(a.m[1], b.m[1])); }
+    inline float8 operator|(const float8 &a, const float8 &b) { return float8(_mm_or_ps(a.m[0], b.m[0]), _mm_or_ps(a.m[1], b.m[1])); }
+    inline float8 select(const float8 &mask, const float8 &a, const float8 &b) // mask ? a : b
+    {
+        return float8(_mm_or_ps(_mm_and_ps(mask.m[0], a.m[0]), _mm_andnot_ps(mask.m[0], b.m[0])),
+                      _mm_or_ps(_mm_and_ps(mask.m[1], a.m[1]), _mm_andnot_ps(mask.m[1], b.m[1])));
+    }
+    inline int bits(const float8 &mask) { return _mm_movemask_ps(mask.m[0]) | _mm_movemask_ps(mask.m[1]) << 4; }
+#else
+#define FLOAT8_LANEWISE(expr)       \
+    float8 r;                       \
+    for (int i = 0; i < 8; ++i)     \
+        r.m[i] = expr;              \
+    return r;
+    inline float lane_mask(bool b)
+    {
+        uint32_t u = b ? 0xffffffffU : 0U;
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+    inline bool lane_set(float f)
+    {
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        return u >> 31;
+    }
+    inline float8 operator+(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(a.m[i] + b.m[i]) }
+    inline float8 operator-(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(a.m[i] - b.m[i]) }
+    inline float8 operator*(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(a.m[i] * b.m[i]) }
+    inline float8 operator/(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(a.m[i] / b.m[i]) }
+    inline float8 operator-(const float8 &a) { FLOAT8_LANEWISE(-a.m[i]) }
+    inline float8 min(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(a.m[i] < b.m[i] ? a.m[i] : b.m[i]) } // same nan rule as minps: b wins
+    inline float8 max(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(a.m[i] > b.m[i] ? a.m[i] : b.m[i]) }
+    inline float8 sqrt(const float8 &a) { FLOAT8_LANEWISE(sqrtf(a.m[i])) }
+    inline float8 abs(const float8 &a) { FLOAT8_LANEWISE(fabsf(a.m[i])) }
+    inline float8 operator<(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(lane_mask(a.m[i] < b.m[i])) }
+    inline float8 operator<=(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(lane_mask(a.m[i] <= b.m[i])) }
+    inline float8 operator>(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(lane_mask(a.m[i] > b.m[i])) }
+    inline float8 operator>=(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(lane_mask(a.m[i] >= b.m[i])) }
+    inline float8 operator&(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(lane_mask(lane_set(a.m[i]) && lane_set(b.m[i]))) }
+    inline float8 operator|(const float8 &a, const float8 &b) { FLOAT8_LANEWISE(lane_mask(lane_set(a.m[i]) || lane_set(b.m[i]))) }
+    inline float8 select(const float8 &mask, const float8 &a, const float8 &b) { FLOAT8_LANEWISE(lane_set(mask.m[i]) ? a.m[i] : b.m[i]) }
+    inline int bits(const float8 &mask)
+    {
+        int r = 0;
+        for (int i = 0; i < 8; ++i)
+            r |= (int)lane_set(mask.m[i]) << i;
+        return r;
+    }
+#undef FLOAT8_LANEWISE
+#endif
+
+    inline bool any(const float8 &mask) { return bits(mask) != 0; }
+    inline bool all(const float8 &mask) { return bits(mask) == 0xff; }
+    inline float8 &float8::operator+=(const float8 &b) { return *this = *this + b; }
+    inline float8 &float8::operator-=(const float8 &b) { return *this = *this - b; }
+    inline float8 &float8::operator*=(const float8 &b) { return *this = *this * b; }
+    inline float8 &float8::operator/=(const float8 &b) { return *this = *this / b; }
+#pragma endregion
+
+#pragma region vec4
+    // one vector in a 4 lane register, w is padding and kept at 0 by every operation that builds a vec4 from xyz,
+    // so dot and length below can sum all four lanes
+    class alignas(16) vec4
+    {
+    public:
+#if defined(__SSE2__)
+        vec4() : m(_mm_setzero_ps()) {}
+        vec4(__m128 m) : m(m) {}
+        vec4(float x) : m(_mm_set_ps(0.0f, x, x, x)) {}
+        vec4(float x, float y, float z) : m(_mm_set_ps(0.0f, z, y, x)) {}
+        inline float operator[](int i) const
+        {
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, m);
+            return lanes[i];
+        }
+        __m128 m;
+#else
+        vec4() : m{0.0f, 0.0f, 0.0f, 0.0f} {}
+        vec4(float x) : m{x, x, x, 0.0f} {}
+        vec4(float x, float y, float z) : m{x, y, z, 0.0f} {}
+        inline float operator[](int i) const { return m[i]; }
+        float m[4];
+#endif
+        vec4(const vec3 &v) : vec4(v.x(), v.y(), v.z()) {}
+        inline vec3 to_vec3() const { return vec3((*this)[0], (*this)[1], (*this)[2]); }
+
+        inline float x() const { return (*this)[0]; }
+        inline float y() const { return (*this)[1]; }
+        inline float z() const { return (*this)[2]; }
+        inline float r() const { return (*this)[0]; }
+        inline float g() const { return (*this)[1]; }
+        inline float b() const { return (*this)[2]; }
+
+        inline vec4 &operator+=(const vec4 &v);
+        inline vec4 &operator-=(const vec4 &v);
+        inline vec4 &operator*=(const vec4 &v);
+        inline vec4 &operator*=(float f);
+        inline vec4 &operator/=(float f);
+
+        inline float squared_length() const;
+        inline float length() const { return ::sqrtf(squared_length()); }
+        inline void make_unit_vector();
+    };
+
+#if defined(__SSE2__)
+    inline vec4 operator+(const vec4 &a, const vec4 &b) { return _mm_add_ps(a.m, b.m); }
+    inline vec4 operator-(const vec4 &a, const vec4 &b) { return _mm_sub_ps(a.m, b.m); }
+    inline vec4 operator*(const vec4 &a, const vec4 &b) { return _mm_mul_ps(a.m, b.m); }
+    inline vec4 operator-(const vec4 &a) { return _mm_xor_ps(a.m, _mm_set1_ps(-0.0f)); }
+    inline vec4 operator*(const vec4 &a, float f) { return _mm_mul_ps(a.m, _mm_set1_ps(f)); }
+    inline vec4 operator/(const vec4 &a, float f) { return _mm_mul_ps(a.m, _mm_set1_ps(1.0f / f)); }
+    inline vec4 min(const vec4 &a, const vec4 &b) { return _mm_min_ps(a.m, b.m); }
+    inline vec4 max(const vec4 &a, const vec4 &b) { return _mm_max_ps(a.m, b.m); }
+    // component division, w is masked back to 0 instead of keeping 0/0
+    inline vec4 operator/(const vec4 &a, const vec4 &b) { return _mm_and_ps(_mm_div_ps(a.m, b.m), _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1))); }
+    inline float dot(const vec4 &a, const vec4 &b)
+    {
+        __m128 p = _mm_mul_ps(a.m, b.m);
+        __m128 s = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1))); // x+y, x+y, z+w, z+w
+        s = _mm_add_ss(s, _mm_movehl_ps(s, s));                                    // x+y+z+w in lane 0
+        return _mm_cvtss_f32(s);
+    }
+    inline vec4 cross(const vec4 &a, const vec4 &b)
+    {
+        __m128 a_yzx = _mm_shuffle_ps(a.m, a.m, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b_yzx = _mm_shuffle_ps(b.m, b.m, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 c = _mm_sub_ps(_mm_mul_ps(a.m, b_yzx), _mm_mul_ps(a_yzx, b.m));
+        return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+#else
+    inline vec4 operator+(const vec4 &a, const vec4 &b) { return vec4(a.m[0] + b.m[0], a.m[1] + b.m[1], a.m[2] + b.m[2]); }
+    inline vec4 operator-(const vec4 &a, const vec4 &b) { return vec4(a.m[0] - b.m[0], a.m[1] - b.m[1], a.m[2] - b.m[2]); }
+    inline vec4 operator*(const vec4 &a, const vec4 &b) { return vec4(a.m[0] * b.m[0], a.m[1] * b.m[1], a.m[2] * b.m[2]); }
+    inline vec4 operator-(const vec4 &a) { return vec4(-a.m[0], -a.m[1], -a.m[2]); }
+    inline vec4 operator*(const vec4 &a, float f) { return vec4(a.m[0] * f, a.m[1] * f, a.m[2] * f); }
+    inline vec4 operator/(const vec4 &a, float f) { return a * (1.0f / f); }
+    inline vec4 min(const vec4 &a, const vec4 &b) { return vec4(fminf(a.m[0], b.m[0]), fminf(a.m[1], b.m[1]), fminf(a.m[2], b.m[2])); }
+    inline vec4 max(const vec4 &a, const vec4 &b) { return vec4(fmaxf(a.m[0], b.m[0]), fmaxf(a.m[1], b.m[1]), fmaxf(a.m[2], b.m[2])); }
+    inline vec4 operator/(const vec4 &a, const vec4 &b) { return vec4(a.m[0] / b.m[0], a.m[1] / b.m[1], a.m[2] / b.m[2]); }
+    inline float dot(const vec4 &a, const vec4 &b) { return a.m[0] * b.m[0] + a.m[1] * b.m[1] + a.m[2] * b.m[2]; }
+    inline vec4 cross(const vec4 &a, const vec4 &b)
+    {
+        return vec4(a.m[1] * b.m[2] - a.m[2] * b.m[1], a.m[2] * b.m[0] - a.m[0] * b.m[2], a.m[0] * b.m[1] - a.m[1] * b.m[0]);
+    }
+#endif
+
+    inline vec4 operator*(float f, const vec4 &a) { return a * f; }
+    inline float vec4::squared_length() const { return dot(*this, *this); }
+    inline void vec4::make_unit_vector() { *this = *this / length(); }
+    inline vec4 &vec4::operator+=(const vec4 &v) { return *this = *this + v; }
+    inline vec4 &vec4::operator-=(const vec4 &v) { return *this = *this - v; }
+    inline vec4 &vec4::operator*=(const vec4 &v) { return *this = *this * v; }
+    inline vec4 &vec4::operator*=(float f) { return *this = *this * f; }
+    inline vec4 &vec4::operator/=(float f) { return *this = *this / f; }
+    inline vec4 unit_vector(const vec4 &v) { return v / v.length(); }
+
+    inline vec4 reflect(const vec4 &v, const vec4 &n) { return v - 2 * dot(v, n) * n; }
+
+    // same contract as the scalar refract in ray.h
+    inline bool refract(const vec4 &v, const vec4 &normal, float ni_over_nt, vec4 &scattered)
+    {
+        vec4 uv = unit_vector(v);
+        float cosine = dot(uv, normal);
+        float discrimination = 1.0f - ni_over_nt * ni_over_nt * (1.0f - cosine * cosine);
+        if (discrimination > 0)
+        {
+            scattered = ni_over_nt * (uv - normal * cosine) - normal * ::sqrtf(discrimination);
+            return true;
+        }
+        scattered = reflect(v, normal);
+        return false;
+    }
+#pragma endregion
+
+#pragma region vec3x8
+    // 8 vectors as three float8 rows, lane i of x, y and z is vector i
+    struct vec3x8
+    {
+        float8 x, y, z;
+
+        vec3x8() {}
+        vec3x8(const float8 &x, const float8 &y, const float8 &z) : x(x), y(y), z(z) {}
+        vec3x8(const vec3 &v) : x(v.x()), y(v.y()), z(v.z()) {} // the same vector in every lane
+
+        // gather from / scatter to an array of 8 vec3 (array of structures)
+        static vec3x8 load(const vec3 *v)
+        {
+            alignas(32) float lanes[3][8];
+            for (int i = 0; i < 8; ++i)
+                for (int k = 0; k < 3; ++k)
+                    lanes[k][i] = v[i][k];
+            return vec3x8(float8::load(lanes[0]), float8::load(lanes[1]), float8::load(lanes[2]));
+        }
+        void store(vec3 *v) const
+        {
+            alignas(32) float lanes[3][8];
+            x.store(lanes[0]);
+            y.store(lanes[1]);
+            z.store(lanes[2]);
+            for (int i = 0; i < 8; ++i)
+                v[i] = vec3(lanes[0][i], lanes[1][i], lanes[2][i]);
+        }
+        inline vec3 get(int lane) const { return vec3(x[lane], y[lane], z[lane]); }
+
+        inline vec3x8 &operator+=(const vec3x8 &v);
+        inline vec3x8 &operator-=(const vec3x8 &v);
+        inline vec3x8 &operator*=(const vec3x8 &v);
+        inline vec3x8 &operator*=(const float8 &f);
+        inline vec3x8 &operator/=(const float8 &f);
+
+        inline float8 squared_length() const { return x * x + y * y + z * z; }
+        inline float8 length() const { return vec::sqrt(squared_length()); }
+    };
+
+    inline vec3x8 operator+(const vec3x8 &a, const vec3x8 &b) { return vec3x8(a.x + b.x, a.y + b.y, a.z + b.z); }
+    inline vec3x8 operator-(const vec3x8 &a, const vec3x8 &b) { return vec3x8(a.x - b.x, a.y - b.y, a.z - b.z); }
+    inline vec3x8 operator*(const vec3x8 &a, const vec3x8 &b) { return vec3x8(a.x * b.x, a.y * b.y, a.z * b.z); }
+    inline vec3x8 operator/(const vec3x8 &a, const vec3x8 &b) { return vec3x8(a.x / b.x, a.y / b.y, a.z / b.z); }
+    inline vec3x8 operator-(const vec3x8 &a) { return vec3x8(-a.x, -a.y, -a.z); }
+    inline vec3x8 operator*(const vec3x8 &a, const float8 &f) { return vec3x8(a.x * f, a.y * f, a.z * f); }
+    inline vec3x8 operator*(const float8 &f, const vec3x8 &a) { return a * f; }
+    inline vec3x8 operator/(const vec3x8 &a, const float8 &f) { return a * (float8(1.0f) / f); }
+    inline vec3x8 select(const float8 &mask, const vec3x8 &a, const vec3x8 &b) { return vec3x8(select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z)); }
+    inline vec3x8 &vec3x8::operator+=(const vec3x8 &v) { return *this = *this + v; }
+    inline vec3x8 &vec3x8::operator-=(const vec3x8 &v) { return *this = *this - v; }
+    inline vec3x8 &vec3x8::operator*=(const vec3x8 &v) { return *this = *this * v; }
+    inline vec3x8 &vec3x8::operator*=(const float8 &f) { return *this = *this * f; }
+    inline vec3x8 &vec3x8::operator/=(const float8 &f) { return *this = *this / f; }
+
+    inline float8 dot(const vec3x8 &a, const vec3x8 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline vec3x8 cross(const vec3x8 &a, const vec3x8 &b) { return vec3x8(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+    inline vec3x8 unit_vector(const vec3x8 &v) { return v / v.length(); }
+    inline vec3x8 reflect(const vec3x8 &v, const vec3x8 &n) { return v - float8(2.0f) * dot(v, n) * n; }
+
+    // lane-wise refract: returns the mask of lanes that refracted, the others get the reflected direction
+    inline float8 refract(const vec3x8 &v, const vec3x8 &normal, const float8 &ni_over_nt, vec3x8 &scattered)
+    {
+        vec3x8 uv = unit_vector(v);
+        float8 cosine = dot(uv, normal);
+        float8 discrimination = float8(1.0f) - ni_over_nt * ni_over_nt * (float8(1.0f) - cosine * cosine);
+        float8 refracted = discrimination > float8(0.0f);
+        vec3x8 bent = ni_over_nt * (uv - normal * cosine) - normal * vec::sqrt(max(discrimination, float8(0.0f)));
+        scattered = select(refracted, bent, reflect(v, normal));
+        return refracted;
+    }
+#pragma endregion
+}
@@ -0,0 +1,93 @@
+// regression check for meshes whose triangles lie in axis planes: a unit cube loaded from obj must be hit on every
+// face by the scalar, occlusion and packet queries, directly and through instances under the top level bvh. build from the repo root with
+//   g++ -std=c++17 -O2 -pthread -I. tests/axis_aligned_mesh.cpp -o axis_aligned_mesh && ./axis_aligned_mesh
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include "material.h"
+#include "obj_loader.h"
+#include "linear_bvh.h"
+#include "packet.h"
+#include "instance.h"
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what, int face)
+{
+    if (!ok)
+    {
+        std::cerr << what << " misses face " << face << std::endl;
+        ++failures;
+    }
+}
+
+int main()
+{
+    const char *path = "axis_aligned_cube.obj";
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return 1;
+    fputs("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 0 1\nv 1 0 1\nv 1 1 1\nv 0 1 1\n"
+          "f 1 4 3 2\nf 5 6 7 8\nf 1 2 6 5\nf 4 8 7 3\nf 1 5 8 4\nf 2 3 7 6\n",
+          fp);
+    fclose(fp);
+    std::shared_ptr<material> gray(new lambertian(std::shared_ptr<texture>(new constant_texture(vec::vec3(0.5, 0.5, 0.5)))));
+    std::shared_ptr<triangle_mesh> mesh = load_obj(path, gray);
+    remove(path);
+    if (!mesh || mesh->triangle_count() != 12)
+    {
+        std::cerr << "cube did not load" << std::endl;
+        return 1;
+    }
+    linear_bvh bvh(mesh, 0.0f, 1.0f);
+
+    // one ray straight at the middle of each face from outside, slightly off center so it does not run along an edge
+    const vec::vec3 targets[6] = {vec::vec3(0.4, 0.45, 0), vec::vec3(0.4, 0.45, 1), vec::vec3(0.4, 0, 0.45),
+                                  vec::vec3(0.4, 1, 0.45), vec::vec3(0, 0.4, 0.45), vec::vec3(1, 0.4, 0.45)};
+    const vec::vec3 normals[6] = {vec::vec3(0, 0, -1), vec::vec3(0, 0, 1), vec::vec3(0, -1, 0),
+                                  vec::vec3(0, 1, 0), vec::vec3(-1, 0, 0), vec::vec3(1, 0, 0)};
+    ray_packet packet;
+    for (int face = 0; face < 6; ++face)
+    {
+        ray r(targets[face] + 2.0f * normals[face], -normals[face], 0.0f);
+        hit_record rec;
+        expect(mesh->hit(r, 0.001f, FLT_MAX, rec) && fabs(rec.t - 2.0f) < 1e-4f, "triangle_mesh::hit", face);
+        expect(mesh->hit_any(r, 0.001f, FLT_MAX), "triangle_mesh::hit_any", face);
+        expect(bvh.hit(r, 0.001f, FLT_MAX, rec), "linear_bvh::hit", face);
+        expect(bvh.hit_any(r, 0.001f, FLT_MAX), "linear_bvh::hit_any", face);
+        packet.rays[face] = r;
+    }
+    packet.rays[6] = packet.rays[0];
+    packet.rays[7] = packet.rays[1];
+    packet.update();
+    alignas(32) float t_max[ray_packet::size];
+    hit_record recs[ray_packet::size];
+    for (int lane = 0; lane < ray_packet::size; ++lane)
+        t_max[lane] = FLT_MAX;
+    int hits = bvh.hit_packet(packet, 0xff, 0.001f, t_max, recs);
+    for (int face = 0; face < 6; ++face)
+        expect(hits >> face & 1, "linear_bvh::hit_packet", face);
+
+    // two copies, one only moved and one turned a quarter about y and doubled, so the world boxes stay axis aligned
+    std::vector<std::shared_ptr<hitable>> instances;
+    const vec::mat3x4 placements[2] = {vec::mat3x4::translate(vec::vec3(-3, 0, 0)),
+                                       vec::mat3x4::translate(vec::vec3(3, 0, 0)) * vec::mat3x4::rotate(vec::vec3(0, 1, 0), 90) * vec::mat3x4::scale(vec::vec3(2))};
+    for (int i = 0; i < 2; ++i)
+        instances.push_back(std::shared_ptr<hitable>(new instance(mesh, placements[i])));
+    std::shared_ptr<hitable> top = make_instance_tree(instances);
+    for (int i = 0; i < 2; ++i)
+        for (int face = 0; face < 6; ++face)
+        {
+            vec::vec3 target = placements[i].transform_point(targets[face]);
+            vec::vec3 normal = vec::unit_vector(placements[i].transform_vector(normals[face]));
+            ray r(target + 2.0f * normal, -normal, 0.0f);
+            hit_record rec;
+            expect(top->hit(r, 0.001f, FLT_MAX, rec) && fabs(rec.t - 2.0f) < 1e-3f, i ? "turned instance hit" : "moved instance hit", face);
+            expect(top->hit_any(r, 0.001f, FLT_MAX), i ? "turned instance hit_any" : "moved instance hit_any", face);
+        }
+
+    if (failures)
+        return 1;
+    std::cout << "axis aligned cube: all faces hit, directly and instanced" << std::endl;
+    return 0;
+}
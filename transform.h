@@ -0,0 +1,197 @@
+#pragma once
+#include <cmath>
+#include <memory>
+#include "hitable.h"
+#include "hitablelist.h"
+#include "geometry.h"
+#include "matrix.h"
+#include "mesh.h"
+
+// world box of object under m, as tight as the object allows: spheres become the exact box of their ellipsoid,
+// meshes use the corners of the boxes a few levels down their bvh, lists and wrappers recurse into their children,
+// anything else falls back to the eight corners of its own box. false if the object has no box
+bool transformed_bounds(const hitable *object, const vec::mat3x4 &m, float t0, float t1, aabb &box);
+
+// an ellipsoid's extent along world axis i is |r| times the length of row i of the linear part
+inline aabb sphere_bounds(const vec::vec3 &center, float radius, const vec::mat3x4 &m)
+{
+    vec::vec3 c = m.transform_point(center), half;
+    for (int i = 0; i < 3; ++i)
+        half[i] = fabs(radius) * sqrt(m.m[i][0] * m.m[i][0] + m.m[i][1] * m.m[i][1] + m.m[i][2] * m.m[i][2]);
+    return aabb(c - half, c + half);
+}
+
+inline void grow(aabb &box, bool &has_box, const aabb &part)
+{
+    box = has_box ? surrounding_box(box, part) : part;
+    has_box = true;
+}
+
+inline void grow_by_corners(aabb &box, bool &has_box, const aabb &local, const vec::mat3x4 &m)
+{
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        vec::vec3 p((corner & 1 ? local.max() : local.min()).x(), (corner & 2 ? local.max() : local.min()).y(), (corner & 4 ? local.max() : local.min()).z());
+        p = m.transform_point(p);
+        grow(box, has_box, aabb(p, p));
+    }
+}
+
+// at most 2^mesh_bounds_depth boxes per mesh: nearly as tight as every vertex, at a cost per transform that does not
+// grow with the mesh
+const int mesh_bounds_depth = 4;
+
+#pragma region transform
+// one affine transform with its inverse precomputed: rays go into object space once per hit, the direction is not
+// renormalized so t needs no rescaling, and normals come back through the inverse transpose. replaces chains of
+// translate / rotate_y, see collapse_transforms
+class transform : public hitable
+{
+public:
+    transform(){};
+    transform(std::shared_ptr<hitable> object, const vec::mat3x4 &to_world);
+
+    virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
+    virtual bool bounding_box(float t0, float t1, aabb &bbox) const override;
+
+    // moves the object between frames: new matrix, inverse and world box
+    void set_to_world(const vec::mat3x4 &m);
+
+    inline ray to_object_space(const ray &r) const { return ray(to_object.transform_point(r.ori), to_object.transform_vector(r.dir), r.get_time()); }
+
+    std::shared_ptr<hitable> object;
+    vec::mat3x4 to_world, to_object;
+    aabb box;
+    bool has_box = false;
+};
+
+transform::transform(std::shared_ptr<hitable> object, const vec::mat3x4 &to_world) : object(object)
+{
+    set_to_world(to_world);
+}
+
+void transform::set_to_world(const vec::mat3x4 &m)
+{
+    to_world = m;
+    to_object = m.inverse();
+    has_box = transformed_bounds(object.get(), to_world, 0, 1, box);
+}
+
+bool transform::hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const
+{
+    if (!object->hit(to_object_space(_ray), t_min, t_max, rec))
+        return false;
+    rec.point = _ray.point_at_parameter(rec.t);
+    rec.normal = vec::unit_vector(to_object.transform_transposed(rec.normal)); // inverse transpose keeps normals normal under scaling
+    return true;
+}
+
+bool transform::hit_any(const ray &_ray, float t_min, float t_max) const
+{
+    return object->hit_any(to_object_space(_ray), t_min, t_max);
+}
+
+bool transform::bounding_box(float t0, float t1, aabb &bbox) const
+{
+    bbox = box;
+    return has_box;
+}
+#pragma endregion
+
+bool transformed_bounds(const hitable *object, const vec::mat3x4 &m, float t0, float t1, aabb &box)
+{
+    bool has_box = false;
+    if (const transform *t = dynamic_cast<const transform *>(object))
+        return transformed_bounds(t->object.get(), m * t->to_world, t0, t1, box);
+    if (const sphere *s = dynamic_cast<const sphere *>(object))
+    {
+        box = sphere_bounds(s->center, s->radius, m);
+        return true;
+    }
+    if (const moving_sphere *s = dynamic_cast<const moving_sphere *>(object))
+    {
+        box = surrounding_box(sphere_bounds(s->center0, s->radius, m), sphere_bounds(s->center1, s->radius, m));
+        return true;
+    }
+    if (const sphere_set *s = dynamic_cast<const sphere_set *>(object))
+    {
+        for (int k = 0; k < s->count; ++k)
+            grow(box, has_box, sphere_bounds(vec::vec3(s->cx[k], s->cy[k], s->cz[k]), s->radius[k], m));
+        return has_box;
+    }
+    if (const triangle_mesh *mesh = dynamic_cast<const triangle_mesh *>(object))
+    {
+        if (mesh->nodes.empty())
+            return false;
+        int stack[mesh_bounds_depth + 1], level[mesh_bounds_depth + 1];
+        int stack_size = 0;
+        stack[stack_size] = 0, level[stack_size++] = 0;
+        while (stack_size)
+        {
+            --stack_size;
+            int index = stack[stack_size], next = level[stack_size] + 1;
+            const linear_bvh_node &node = mesh->nodes[index];
+            if (node.prim_count || next > mesh_bounds_depth)
+            {
+                grow_by_corners(box, has_box, node.box, m);
+                continue;
+            }
+            stack[stack_size] = node.offset, level[stack_size++] = next;
+            stack[stack_size] = index + 1, level[stack_size++] = next;
+        }
+        return has_box;
+    }
+    if (const hitable_list *list = dynamic_cast<const hitable_list *>(object))
+    {
+        aabb part;
+        for (int i = 0; i < list->list_size; ++i)
+            if (transformed_bounds(list->list[i].get(), m, t0, t1, part))
+                grow(box, has_box, part);
+        return has_box;
+    }
+    if (const filp_normals *f = dynamic_cast<const filp_normals *>(object))
+        return transformed_bounds(f->ptr.get(), m, t0, t1, box);
+    if (const constant_medium *c = dynamic_cast<const constant_medium *>(object))
+        return transformed_bounds(c->boundary.get(), m, t0, t1, box);
+
+    aabb local;
+    if (!object->bounding_box(t0, t1, local))
+        return false;
+    grow_by_corners(box, has_box, local, m);
+    return has_box;
+}
+
+// the matrix of one translate or rotate_y wrapper
+inline vec::mat3x4 wrapper_matrix(const translate *t) { return vec::mat3x4::translate(t->offset); }
+
+inline vec::mat3x4 wrapper_matrix(const rotate_y *r)
+{
+    vec::mat3x4 m;
+    m.m[0][0] = r->cos_theta;
+    m.m[0][2] = r->sin_theta;
+    m.m[2][0] = -r->sin_theta;
+    m.m[2][2] = r->cos_theta;
+    return m;
+}
+
+// scene build time: a chain of translate, rotate_y and transform wrappers becomes one transform around the innermost
+// object, outer wrappers applied last. anything that is not a wrapper comes back unchanged
+std::shared_ptr<hitable> collapse_transforms(std::shared_ptr<hitable> node)
+{
+    vec::mat3x4 m;
+    int wrappers = 0;
+    while (true)
+    {
+        if (const translate *t = dynamic_cast<const translate *>(node.get()))
+            m = m * wrapper_matrix(t), node = t->hit_ptr;
+        else if (const rotate_y *r = dynamic_cast<const rotate_y *>(node.get()))
+            m = m * wrapper_matrix(r), node = r->hit_ptr;
+        else if (const transform *x = dynamic_cast<const transform *>(node.get()))
+            m = m * x->to_world, node = x->object;
+        else
+            break;
+        ++wrappers;
+    }
+    return wrappers ? std::shared_ptr<hitable>(new transform(node, m)) : node;
+}
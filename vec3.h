@@ -1,11 +1,20 @@
 #pragma once
 #include <math.h>
+#include <cmath>
 #include <stdlib.h>
 #include <iostream>
 #define FLT_MAX (float)0x3f3f3f3f
-bool DE_NAN = false;
+// division policy, fixed at build time: by default vec3 division is a plain divide and whatever inf or nan comes out
+// is cleaned once per sample by de_nan where the renderer accumulates. build with -DVEC_SAFE_DIV=1 to get the old
+// guarded division, which scales the numerator by FLT_MAX when a divisor is closer to 0 than 1e-5
+#ifndef VEC_SAFE_DIV
+#define VEC_SAFE_DIV 0
+#endif
 namespace vec
 {
+	constexpr bool safe_division = VEC_SAFE_DIV != 0;
+	constexpr float safe_division_threshold = 1e-5f;
+
 	class vec3
 	{
 	public:
@@ -43,7 +52,7 @@ namespace vec
 		inline const vec3 &operator+() const { return *this; }
 		inline const vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
 		inline const vec3 &operator()(const vec3 &vec) const { return vec; }
-		// inline float operator[](int i) const { return e[i]; }  // 返回右值
+		inline float operator[](int i) const { return e[i]; }  // 返回右值
 		inline float &operator[](int i) { return e[i]; } // 返回左值
 
 		inline vec3 &operator+=(const vec3 &v);
@@ -105,8 +114,8 @@ namespace vec
 
 	inline vec3 operator/(const vec3 &v1, const vec3 &v2)
 	{
-		float threshold = 1e-5;
-		if (DE_NAN && (fabs(v2.e[0]) < threshold || fabs(v2.e[1]) < threshold || fabs(v2.e[2]) < threshold))
+		float threshold = safe_division_threshold;
+		if (safe_division && (fabs(v2.e[0]) < threshold || fabs(v2.e[1]) < threshold || fabs(v2.e[2]) < threshold))
 		{
 			// std::cout << "div 0 Error!!!" << std::endl;
 			return v1 * FLT_MAX;
@@ -121,13 +130,7 @@ namespace vec
 
 	inline vec3 operator/(float f, const vec3 &vec)
 	{
-		float threshold = 1e-5;
-		if (DE_NAN && (fabs(f) < threshold))
-		{
-			// std::cout << "div 0 Error!!!" << std::endl;
-			return vec * FLT_MAX;
-		}
-		return vec3(vec.e[0] / f, vec.e[1] / f, vec.e[2] / f);
+		return vec3(f) / vec;
 	}
 
 	inline vec3 operator*(const vec3 &vec, float f)
@@ -137,8 +140,8 @@ namespace vec
 
 	inline vec3 operator/(const vec3 &vec, float f)
 	{
-		float threshold = (float)1e-5;
-		if (DE_NAN && (fabs(f) < threshold))
+		float threshold = safe_division_threshold;
+		if (safe_division && (fabs(f) < threshold))
 		{
 			// std::cout << "div 0 Error!!!" << std::endl;
 			return vec * FLT_MAX;
@@ -228,15 +231,14 @@ namespace vec
 		return vec / vec.length();
 	}
 
+	// zero every component that is nan or inf, applied once per sample before it is accumulated so a single bad path
+	// can not poison a pixel's sum
 	inline vec3 de_nan(const vec3 &c)
 	{
 		vec3 temp = c;
-		if (!(temp[0] == temp[0]))
-			temp[0] = 0;
-		if (!(temp[1] == temp[1]))
-			temp[1] = 0;
-		if (!(temp[2] == temp[2]))
-			temp[2] = 0;
+		for (int i = 0; i < 3; i++)
+			if (!std::isfinite(temp[i]))
+				temp[i] = 0;
 		return temp;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,305 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+#include "linear_bvh.h"
+
+// W-ary bvh collapsed from a binary linear_bvh. child bounds are stored per axis (bmin[axis][child]) so one ray is
+// tested against all W children with a single run of simd min/max: sse for bvh4, avx for bvh8 when built with -mavx
+template <int W>
+struct alignas(64) wide_bvh_node
+{
+    float bmin[3][W];
+    float bmax[3][W];
+    int32_t child[W]; // node index for interior children, first prim index for leaves, -1 for an empty slot
+    int32_t count[W]; // prim count of leaf children, 0 otherwise
+};
+
+template <int W>
+inline int hit_wide_node(const ray &_ray, const wide_bvh_node<W> &node, float t_min, float t_max, float (&t_entry)[W])
+{
+    return hit_boxes<W>(_ray, node.bmin, node.bmax, t_min, t_max, t_entry);
+}
+
+#if defined(__SSE2__)
+// max/min take the slab distance first so a nan (ray origin on a slab plane with a zero direction component) keeps the running bound
+template <>
+inline int hit_wide_node<4>(const ray &_ray, const wide_bvh_node<4> &node, float t_min, float t_max, float (&t_entry)[4])
+{
+    __m128 near = _mm_set1_ps(t_min), far = _mm_set1_ps(t_max);
+    for (int i = 0; i < 3; i++)
+    {
+        __m128 o = _mm_set1_ps(_ray.ori[i]), inv = _mm_set1_ps(_ray.inv_dir[i]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(_ray.sign[i] ? node.bmax[i] : node.bmin[i]), o), inv);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(_ray.sign[i] ? node.bmin[i] : node.bmax[i]), o), inv);
+        near = _mm_max_ps(t0, near);
+        far = _mm_min_ps(t1, far);
+    }
+    _mm_storeu_ps(t_entry, near);
+    return _mm_movemask_ps(_mm_cmplt_ps(near, far));
+}
+#endif
+
+#if defined(__AVX__)
+template <>
+inline int hit_wide_node<8>(const ray &_ray, const wide_bvh_node<8> &node, float t_min, float t_max, float (&t_entry)[8])
+{
+    __m256 near = _mm256_set1_ps(t_min), far = _mm256_set1_ps(t_max);
+    for (int i = 0; i < 3; i++)
+    {
+        __m256 o = _mm256_set1_ps(_ray.ori[i]), inv = _mm256_set1_ps(_ray.inv_dir[i]);
+        __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(_ray.sign[i] ? node.bmax[i] : node.bmin[i]), o), inv);
+        __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(_ray.sign[i] ? node.bmin[i] : node.bmax[i]), o), inv);
+        near = _mm256_max_ps(t0, near);
+        far = _mm256_min_ps(t1, far);
+    }
+    _mm256_storeu_ps(t_entry, near);
+    return _mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LT_OQ));
+}
+#endif
+
+template <int W>
+class wide_bvh : public hitable
+{
+public:
+    // every wide level pushes at most W - 1 entries past the one it pops, and there are no more levels than in the
+    // source linear_bvh, whose build keeps it within linear_bvh::max_depth
+    static const int max_stack = linear_bvh::max_depth * (W - 1) + 1;
+
+    wide_bvh(){};
+    wide_bvh(std::shared_ptr<hitable> root, float time0, float time1);
+
+    virtual bool hit(const ray &ray, float t_min, float t_max, hit_record &rec) const override;
+    virtual bool hit_any(const ray &ray, float t_min, float t_max) const override;
+    virtual int hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const override;
+    virtual bool bounding_box(float t0, float t1, aabb &bbox) const override;
+
+    std::vector<wide_bvh_node<W>> nodes;
+    std::vector<hitable *> prims;
+    std::shared_ptr<linear_bvh> source; // binary tree the nodes were collapsed from, owns the primitives
+    aabb bbox;
+
+private:
+    struct entry
+    {
+        int32_t child, count;
+        float t;
+    };
+    struct packet_entry
+    {
+        vec::float8 t; // per lane entry distance
+        int32_t child, count, mask;
+        float nearest;
+    };
+    int collapse(int index);
+};
+
+typedef wide_bvh<4> bvh4;
+typedef wide_bvh<8> bvh8;
+
+template <int W>
+wide_bvh<W>::wide_bvh(std::shared_ptr<hitable> root, float time0, float time1)
+{
+    source = std::dynamic_pointer_cast<linear_bvh>(root);
+    if (!source)
+        source.reset(new linear_bvh(root, time0, time1));
+    prims = source->prims;
+    source->bounding_box(time0, time1, bbox);
+    if (!source->nodes.empty())
+        collapse(0);
+}
+
+// pull grandchildren up until the node has W children: the interior child with the largest surface area is
+// replaced by its two children first, which keeps big overlapping boxes near the root as the sah build intended
+template <int W>
+int wide_bvh<W>::collapse(int index)
+{
+    const std::vector<linear_bvh_node> &src = source->nodes;
+    std::vector<int> kids;
+    if (src[index].prim_count)
+        kids.push_back(index); // single leaf tree
+    else
+    {
+        kids.push_back(index + 1);
+        kids.push_back(src[index].offset);
+    }
+    while ((int)kids.size() < W)
+    {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int k = 0; k < (int)kids.size(); ++k)
+        {
+            if (!src[kids[k]].prim_count && surface_area(src[kids[k]].box) > best_area)
+            {
+                best = k;
+                best_area = surface_area(src[kids[k]].box);
+            }
+        }
+        if (best < 0)
+            break;
+        int opened = kids[best];
+        kids[best] = opened + 1;
+        kids.push_back(src[opened].offset);
+    }
+
+    int node_index = (int)nodes.size();
+    nodes.emplace_back();
+    for (int k = 0; k < W; ++k)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            nodes[node_index].bmin[i][k] = FLT_MAX; // empty slots can never be hit
+            nodes[node_index].bmax[i][k] = -FLT_MAX;
+        }
+        nodes[node_index].child[k] = -1;
+        nodes[node_index].count[k] = 0;
+    }
+    for (int k = 0; k < (int)kids.size(); ++k)
+    {
+        const linear_bvh_node &kid = src[kids[k]];
+        int child = kid.prim_count ? kid.offset : collapse(kids[k]); // recursion may grow nodes, so index again below
+        wide_bvh_node<W> &node = nodes[node_index];
+        for (int i = 0; i < 3; ++i)
+        {
+            node.bmin[i][k] = kid.box.min()[i];
+            node.bmax[i][k] = kid.box.max()[i];
+        }
+        node.child[k] = child;
+        node.count[k] = kid.prim_count;
+    }
+    return node_index;
+}
+
+template <int W>
+bool wide_bvh<W>::hit(const ray &_ray, float t_min, float t_max, hit_record &rec) const
+{
+    if (nodes.empty())
+        return false;
+    entry stack[max_stack];
+    int stack_size = 0;
+    stack[stack_size++] = entry{0, 0, t_min};
+    bool hit_anything = false;
+    while (stack_size)
+    {
+        entry e = stack[--stack_size];
+        if (e.t >= t_max) // box starts beyond the closest hit found since it was pushed
+            continue;
+        if (e.count)
+        {
+            for (int i = 0; i < e.count; ++i)
+            {
+                if (prims[e.child + i]->hit(_ray, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+            continue;
+        }
+        const wide_bvh_node<W> &node = nodes[e.child];
+        float t_entry[W];
+        int mask = hit_wide_node<W>(_ray, node, t_min, t_max, t_entry);
+        // push hit children far to near so the nearest is popped first: insertion sort into the stack top by entry distance
+        int base = stack_size;
+        for (int k = 0; k < W; ++k)
+        {
+            if (!(mask >> k & 1))
+                continue;
+            entry child{node.child[k], node.count[k], t_entry[k]};
+            int j = stack_size++;
+            while (j > base && stack[j - 1].t < child.t)
+            {
+                stack[j] = stack[j - 1];
+                --j;
+            }
+            stack[j] = child;
+        }
+    }
+    return hit_anything;
+}
+
+// children are tested one box at a time against all lanes and pushed far to near by their nearest lane. a popped
+// entry keeps only the lanes whose closest hit so far is still behind the box entry
+template <int W>
+int wide_bvh<W>::hit_packet(const ray_packet &packet, int mask, float t_min, float *t_max, hit_record *rec) const
+{
+    if (nodes.empty())
+        return 0;
+    packet_entry stack[max_stack];
+    int stack_size = 0;
+    stack[stack_size++] = packet_entry{vec::float8(t_min), 0, 0, mask, t_min};
+    int hits = 0;
+    while (stack_size)
+    {
+        packet_entry e = stack[--stack_size];
+        int active = e.mask & vec::bits(e.t < vec::float8::load(t_max));
+        if (!active)
+            continue;
+        if (e.count)
+        {
+            for (int i = 0; i < e.count; ++i)
+                hits |= prims[e.child + i]->hit_packet(packet, active, t_min, t_max, rec);
+            continue;
+        }
+        const wide_bvh_node<W> &node = nodes[e.child];
+        vec::float8 lane_t_max = vec::float8::load(t_max);
+        int base = stack_size;
+        for (int k = 0; k < W; ++k)
+        {
+            if (node.child[k] < 0)
+                continue;
+            vec::float8 t_near;
+            vec::vec3 bmin(node.bmin[0][k], node.bmin[1][k], node.bmin[2][k]), bmax(node.bmax[0][k], node.bmax[1][k], node.bmax[2][k]);
+            int child_mask = active & hit_box_packet(packet, bmin, bmax, t_min, lane_t_max, t_near);
+            if (!child_mask)
+                continue;
+            packet_entry child{t_near, node.child[k], node.count[k], child_mask, nearest_lane(t_near, child_mask)};
+            int j = stack_size++;
+            while (j > base && stack[j - 1].nearest < child.nearest)
+            {
+                stack[j] = stack[j - 1];
+                --j;
+            }
+            stack[j] = child;
+        }
+    }
+    return hits;
+}
+
+template <int W>
+bool wide_bvh<W>::hit_any(const ray &_ray, float t_min, float t_max) const
+{
+    if (nodes.empty())
+        return false;
+    entry stack[max_stack];
+    int stack_size = 0;
+    stack[stack_size++] = entry{0, 0, t_min};
+    while (stack_size)
+    {
+        entry e = stack[--stack_size];
+        if (e.count)
+        {
+            for (int i = 0; i < e.count; ++i)
+                if (prims[e.child + i]->hit_any(_ray, t_min, t_max))
+                    return true;
+            continue;
+        }
+        const wide_bvh_node<W> &node = nodes[e.child];
+        float t_entry[W];
+        int mask = hit_wide_node<W>(_ray, node, t_min, t_max, t_entry);
+        for (int k = 0; k < W; ++k)
+            if (mask >> k & 1)
+                stack[stack_size++] = entry{node.child[k], node.count[k], t_entry[k]};
+    }
+    return false;
+}
+
+template <int W>
+bool wide_bvh<W>::bounding_box(float t0, float t1, aabb &box) const
+{
+    box = bbox;
+    return !nodes.empty();
+}